@@ -0,0 +1,307 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+#ifdef LINUX
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/mempolicy.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "main.h"
+#include "arena.h"
+
+#ifdef LINUX
+
+#define ARENA_PAGE_DEFAULT	(2*1024*1024)	/* huge page size, when /proc/meminfo does not say */
+
+typedef struct arena_node {
+	unsigned char *cur;			/* next free byte of the run held for this node */
+	size_t left;				/* bytes left in the run */
+} arena_node_t;
+
+struct arena {
+	unsigned char *map;			/* the mapping, as returned by mmap */
+	size_t map_len;
+	unsigned char *base;		/* map, aligned to page */
+	size_t len;					/* usable bytes from base */
+	size_t used;				/* bytes from base handed out as runs */
+	size_t page;				/* huge page size, runs are a multiple of this */
+	BOOL huge;					/* backed by MAP_HUGETLB, rather then THP or normal pages */
+	BOOL thp;					/* transparent huge pages were asked for, and are enabled */
+	unsigned int nodes;
+	arena_node_t *node;			/* one open run per NUMA node */
+	pthread_mutex_t lock;
+};
+
+/*
+ * Returns the huge page size, and sets pfree to the number of reserved
+ * huge pages not yet in use.
+ */
+static size_t huge_page_size(unsigned long *pfree)
+{
+	FILE *fp;
+	char line[80];
+	unsigned long kb = 0;
+
+	*pfree = 0;
+	if((fp = fopen("/proc/meminfo", "r")) != NULL) {
+		while(fgets(line, sizeof(line), fp) != NULL) {
+			if(sscanf(line, "HugePages_Free: %lu", pfree) == 1) continue;
+			if(sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) continue;
+		}
+		fclose(fp);
+	}
+	return (kb > 0) ? (size_t) kb*1024 : ARENA_PAGE_DEFAULT;
+}
+
+/*
+ * TRUE when THP is on for madvised memory, "[always]" or "[madvise]".
+ */
+static BOOL thp_enabled(void)
+{
+	FILE *fp;
+	char line[80];
+	BOOL on = FALSE;
+
+	if((fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r")) != NULL) {
+		if(fgets(line, sizeof(line), fp) != NULL) {
+			on = (strstr(line, "[never]") == NULL) ? TRUE : FALSE;
+		}
+		fclose(fp);
+	}
+	return on;
+}
+
+static unsigned int numa_nodes(void)
+{
+	FILE *fp;
+	char line[80], *p;
+	unsigned int nodes = 1;
+
+	/* "0", or "0-3", the last node is the highest */
+	if((fp = fopen("/sys/devices/system/node/possible", "r")) != NULL) {
+		if(fgets(line, sizeof(line), fp) != NULL) {
+			if((p = strrchr(line, '-')) == NULL) p = line - 1;
+			nodes = (unsigned int) strtoul(p+1, NULL, 10) + 1;
+		}
+		fclose(fp);
+	}
+	return nodes;
+}
+
+static unsigned int current_node(void)
+{
+	unsigned int cpu = 0, node = 0;
+
+	if(syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return 0;
+	return node;
+}
+
+/*
+ * Prefer the node for the run, and fault it in from this thread.  A
+ * failed mbind is ignored, first touch still puts the pages local.
+ */
+static int place_run(arena_t *arena, unsigned char *run, const size_t len, const unsigned int node)
+{
+	unsigned long mask;
+
+	if(node < sizeof(mask)*8) {
+		mask = 1UL << node;
+		syscall(SYS_mbind, run, len, MPOL_PREFERRED, &mask, sizeof(mask)*8, 0);
+	}
+#ifdef MADV_POPULATE_WRITE
+	/* returns an error, rather then SIGBUS, when huge pages run out */
+	if(madvise(run, len, MADV_POPULATE_WRITE) != 0) {
+		return (arena->huge) ? -1 : 0;
+	}
+#endif
+	return 0;
+}
+
+#endif /* LINUX */
+
+/*
+ * Maps an arena with room for count buffers, of size bytes in all.
+ * Returns NULL if arenas are not supported, or no memory could be mapped.
+ */
+arena_t *ArenaOpen(const size_t size, const unsigned int count)
+{
+#ifdef LINUX
+	arena_t *arena;
+	size_t slack;
+	unsigned long huge_free;
+
+	if((arena = (arena_t *) ALLOC(sizeof(arena_t))) == NULL) return NULL;
+	memset(arena, 0, sizeof(arena_t));
+	arena->page = huge_page_size(&huge_free);
+	arena->nodes = numa_nodes();
+	if((arena->node = (arena_node_t *) ALLOC(arena->nodes*sizeof(arena_node_t))) == NULL) {
+		FREE(arena);
+		return NULL;
+	}
+	memset(arena->node, 0, arena->nodes*sizeof(arena_node_t));
+
+	/*
+	 * Every node may leave part of a run unused each time it starts a new
+	 * one, so leave room for a page per buffer, past the buffers.  Pages
+	 * are only taken when a run is placed, so the slack costs address
+	 * space, not memory.
+	 */
+	slack = ((size_t) count+arena->nodes)*arena->page;
+	arena->len = ((size+arena->page-1)/arena->page)*arena->page + slack;
+
+	arena->map = MAP_FAILED;
+#ifdef MADV_POPULATE_WRITE
+	/* only when the buffers fit in the free huge pages, with a page per node to spare */
+	if(huge_free*arena->page >= ((size+arena->page-1)/arena->page + arena->nodes)*arena->page) {
+		arena->map_len = arena->len;
+		arena->map = mmap(NULL, arena->map_len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_HUGETLB, -1, 0);
+		if(arena->map != MAP_FAILED) {
+			arena->huge = TRUE;
+			arena->base = arena->map;
+		}
+	}
+#endif
+	if(arena->map == MAP_FAILED) {
+		/* no huge pages reserved, ask for transparent ones on aligned runs */
+		arena->map_len = arena->len + arena->page;
+		arena->map = mmap(NULL, arena->map_len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+		if(arena->map == MAP_FAILED) {
+			FREE(arena->node);
+			FREE(arena);
+			return NULL;
+		}
+		arena->base = (unsigned char *) (((size_t) arena->map + arena->page - 1) & ~(arena->page - 1));
+#ifdef MADV_HUGEPAGE
+		if(madvise(arena->base, arena->len, MADV_HUGEPAGE) == 0) {
+			arena->thp = thp_enabled();
+		}
+#endif
+	}
+	pthread_mutex_init(&arena->lock, NULL);
+	return arena;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * Hands out an ALIGNSIZE aligned buffer from the run held for the
+ * caller's NUMA node, starting a new run when that one is used up.
+ * Buffers are only given back when the arena is closed.  Returns NULL
+ * when the arena is full, or its huge pages have run out, so the
+ * caller can fall back to the heap.
+ */
+void *ArenaAlloc(arena_t *arena, const size_t size)
+{
+#ifdef LINUX
+	arena_node_t *n;
+	unsigned int node = current_node();
+	size_t len = ((size+ALIGNSIZE-1)/ALIGNSIZE)*ALIGNSIZE;
+	size_t run;
+	void *p = NULL;
+
+	if(node >= arena->nodes) node = 0;
+	n = &arena->node[node];
+
+	pthread_mutex_lock(&arena->lock);
+	if(n->left < len) {
+		if((n->cur != NULL) && (n->cur + n->left == arena->base + arena->used)) {
+			/* this node has the last run, so grow it in place */
+			run = ((len-n->left+arena->page-1)/arena->page)*arena->page;
+		} else {
+			n->cur = arena->base + arena->used;
+			n->left = 0;
+			run = ((len+arena->page-1)/arena->page)*arena->page;
+		}
+		if((arena->used + run > arena->len) ||
+		   (place_run(arena, arena->base + arena->used, run, node) != 0)) {
+			pthread_mutex_unlock(&arena->lock);
+			return NULL;
+		}
+		arena->used += run;
+		n->left += run;
+	}
+	p = n->cur;
+	n->cur += len;
+	n->left -= len;
+	pthread_mutex_unlock(&arena->lock);
+	return p;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * TRUE when buf was handed out by the arena, rather then the heap.
+ */
+BOOL ArenaOwns(const arena_t *arena, const void *buf)
+{
+#ifdef LINUX
+	const unsigned char *p = buf;
+
+	return ((p >= arena->base) && (p < arena->base + arena->used)) ? TRUE : FALSE;
+#else
+	return FALSE;
+#endif
+}
+
+/*
+ * Names the pages backing the arena, for the START messages.
+ */
+const char *ArenaPages(const arena_t *arena)
+{
+#ifdef LINUX
+	if(arena->huge) return "huge";
+	if(arena->thp) return "transparent huge";
+#endif
+	return "normal";
+}
+
+void ArenaClose(arena_t *arena)
+{
+#ifdef LINUX
+	if(arena == NULL) return;
+	munmap(arena->map, arena->map_len);
+	pthread_mutex_destroy(&arena->lock);
+	FREE(arena->node);
+	FREE(arena);
+#endif
+}
@@ -0,0 +1,49 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifndef _ARENA_H
+#define _ARENA_H 1
+
+#include "defs.h"
+
+/*
+ * Buffer arena for IO buffers, shared by all children of a target.  The
+ * arena is one mapping backed by huge pages when the system has them,
+ * and transparent huge pages or normal pages when it does not.  Each
+ * buffer is placed on the NUMA node of the thread that asks for it.
+ */
+typedef struct arena arena_t;
+
+arena_t *ArenaOpen(const size_t, const unsigned int);
+void *ArenaAlloc(arena_t *, const size_t);
+BOOL ArenaOwns(const arena_t *, const void *);
+const char *ArenaPages(const arena_t *);
+void ArenaClose(arena_t *);
+
+#endif /* _ARENA_H */
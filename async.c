@@ -0,0 +1,479 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#ifdef LINUX
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <linux/aio_abi.h>
+#endif
+#include <errno.h>
+#include <string.h>
+
+#include "defs.h"
+#include "main.h"
+#include "io.h"
+#include "async.h"
+#include "timer.h"
+
+#ifdef LINUX
+
+struct async_ctx {
+	OFF_T engine;				/* CLD_FLG_URING or CLD_FLG_LIBAIO */
+	fd_t fd;					/* target the context is bound to */
+	unsigned int depth;			/* max number of outstanding transfers */
+	unsigned int queued;		/* transfers queued, but not yet submitted */
+	struct iovec *iov;			/* one io vector per slot */
+	async_event_t *failed;		/* transfers that could not be submitted */
+	unsigned int nfailed;
+	/* io_uring */
+	int ring_fd;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_ring_len;
+	size_t cq_ring_len;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	struct io_uring_cqe *cqes;
+	BOOL ext_arg;				/* kernel takes a timeout on io_uring_enter */
+	/* linux native aio */
+	aio_context_t aio_ctx;
+	struct iocb *iocbs;			/* one iocb per slot */
+	struct iocb **iocbq;		/* iocbs queued, but not yet submitted */
+	struct io_event *aio_events;
+};
+
+static int uring_setup(async_ctx_t *ctx)
+{
+	struct io_uring_params params;
+
+	memset(&params, 0, sizeof(params));
+	ctx->ring_fd = (int) syscall(__NR_io_uring_setup, ctx->depth, &params);
+	if(ctx->ring_fd < 0) {
+		return -1;
+	}
+#ifdef IORING_FEAT_EXT_ARG
+	ctx->ext_arg = (params.features & IORING_FEAT_EXT_ARG) ? TRUE : FALSE;
+#endif
+
+	ctx->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ctx->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP) {
+		if(ctx->cq_ring_len > ctx->sq_ring_len) ctx->sq_ring_len = ctx->cq_ring_len;
+		ctx->cq_ring_len = ctx->sq_ring_len;
+	}
+
+	ctx->sq_ring = mmap(NULL, ctx->sq_ring_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ctx->ring_fd, IORING_OFF_SQ_RING);
+	if(ctx->sq_ring == MAP_FAILED) {
+		ctx->sq_ring = NULL;
+		return -1;
+	}
+	if(params.features & IORING_FEAT_SINGLE_MMAP) {
+		ctx->cq_ring = ctx->sq_ring;
+	} else {
+		ctx->cq_ring = mmap(NULL, ctx->cq_ring_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ctx->ring_fd, IORING_OFF_CQ_RING);
+		if(ctx->cq_ring == MAP_FAILED) {
+			ctx->cq_ring = NULL;
+			return -1;
+		}
+	}
+	ctx->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sqes = mmap(NULL, ctx->sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ctx->ring_fd, IORING_OFF_SQES);
+	if(ctx->sqes == MAP_FAILED) {
+		ctx->sqes = NULL;
+		return -1;
+	}
+
+	ctx->sq_head = (unsigned int *) ((char *) ctx->sq_ring + params.sq_off.head);
+	ctx->sq_tail = (unsigned int *) ((char *) ctx->sq_ring + params.sq_off.tail);
+	ctx->sq_mask = (unsigned int *) ((char *) ctx->sq_ring + params.sq_off.ring_mask);
+	ctx->sq_array = (unsigned int *) ((char *) ctx->sq_ring + params.sq_off.array);
+	ctx->cq_head = (unsigned int *) ((char *) ctx->cq_ring + params.cq_off.head);
+	ctx->cq_tail = (unsigned int *) ((char *) ctx->cq_ring + params.cq_off.tail);
+	ctx->cq_mask = (unsigned int *) ((char *) ctx->cq_ring + params.cq_off.ring_mask);
+	ctx->cqes = (struct io_uring_cqe *) ((char *) ctx->cq_ring + params.cq_off.cqes);
+
+	return 0;
+}
+
+static int uring_queue(async_ctx_t *ctx, const unsigned int slot, const op_t oper, const OFF_T pos)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail, idx;
+
+	tail = *ctx->sq_tail;
+	idx = tail & *ctx->sq_mask;
+	sqe = &ctx->sqes[idx];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = (oper == WRITER) ? IORING_OP_WRITEV : IORING_OP_READV;
+	sqe->fd = ctx->fd;
+	sqe->addr = (unsigned long) &ctx->iov[slot];
+	sqe->len = 1;
+	sqe->off = (unsigned long long) pos;
+	sqe->user_data = slot;
+
+	ctx->sq_array[idx] = idx;
+	__atomic_store_n(ctx->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int uring_submit(async_ctx_t *ctx)
+{
+	int rv;
+	unsigned int tail, i;
+
+	while(ctx->queued > 0) {
+		rv = (int) syscall(__NR_io_uring_enter, ctx->ring_fd, ctx->queued, 0, 0, NULL, 0);
+		if(rv < 0) {
+			if(errno == EINTR) continue;
+			/* short of resources or completion space, leave the rest queued for the caller to reap first */
+			if((errno == EAGAIN) || (errno == EBUSY)) return (int) ctx->queued;
+			/*
+			 * The ring itself is unusable, so pull back whatever the
+			 * kernel has not consumed and fail those transfers.
+			 */
+			tail = *ctx->sq_tail;
+			for(i = tail - ctx->queued; i != tail; i++) {
+				ctx->failed[ctx->nfailed].slot = (unsigned int) ctx->sqes[ctx->sq_array[i & *ctx->sq_mask]].user_data;
+				ctx->failed[ctx->nfailed].result = -errno;
+				ctx->nfailed++;
+			}
+			__atomic_store_n(ctx->sq_tail, tail - ctx->queued, __ATOMIC_RELEASE);
+			ctx->queued = 0;
+			return -1;
+		}
+		ctx->queued -= rv;
+	}
+	return 0;
+}
+
+/*
+ * waits up to wait nsecs for nr completions.  Kernels without a timeout
+ * on io_uring_enter can only be polled, so sleep in short steps.
+ */
+#define URING_POLL		50000
+
+static int uring_wait(async_ctx_t *ctx, const unsigned int nr, const OFF_T wait)
+{
+#ifdef IORING_ENTER_EXT_ARG
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+
+	if(ctx->ext_arg) {
+		ts.tv_sec = wait / NSECS_PER_SEC;
+		ts.tv_nsec = wait % NSECS_PER_SEC;
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (unsigned long long) (unsigned long) &ts;
+		if(syscall(__NR_io_uring_enter, ctx->ring_fd, 0, nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0) {
+			if((errno != ETIME) && (errno != EINTR)) return -1;
+		}
+		return 0;
+	}
+#endif
+	sleepUntil(getMonoTime() + ((wait < URING_POLL) ? wait : URING_POLL));
+	return 0;
+}
+
+static int uring_reap(async_ctx_t *ctx, async_event_t *events, unsigned int n, const unsigned int min_nr, const unsigned int max_nr, const OFF_T until)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int head, tail;
+	OFF_T now;
+
+	for(;;) {
+		head = *ctx->cq_head;
+		tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+		while((head != tail) && (n < max_nr)) {
+			cqe = &ctx->cqes[head & *ctx->cq_mask];
+			events[n].slot = (unsigned int) cqe->user_data;
+			events[n].result = (long) cqe->res;
+			n++;
+			head++;
+		}
+		__atomic_store_n(ctx->cq_head, head, __ATOMIC_RELEASE);
+
+		if(n >= min_nr) break;
+
+		if(until != 0) {
+			if((now = getMonoTime()) >= until) break;
+			if(uring_wait(ctx, min_nr - n, until - now) < 0) return -1;
+			continue;
+		}
+		if(syscall(__NR_io_uring_enter, ctx->ring_fd, 0, min_nr - n, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+			if(errno != EINTR) return -1;
+		}
+	}
+	return (int) n;
+}
+
+static void uring_close(async_ctx_t *ctx)
+{
+	if(ctx->sqes) munmap(ctx->sqes, ctx->sqes_len);
+	if(ctx->cq_ring && (ctx->cq_ring != ctx->sq_ring)) munmap(ctx->cq_ring, ctx->cq_ring_len);
+	if(ctx->sq_ring) munmap(ctx->sq_ring, ctx->sq_ring_len);
+	if(ctx->ring_fd >= 0) close(ctx->ring_fd);
+}
+
+static int aio_setup(async_ctx_t *ctx)
+{
+	if(((ctx->iocbs = (struct iocb *) ALLOC(ctx->depth * sizeof(struct iocb))) == NULL) ||
+	   ((ctx->iocbq = (struct iocb **) ALLOC(ctx->depth * sizeof(struct iocb *))) == NULL) ||
+	   ((ctx->aio_events = (struct io_event *) ALLOC(ctx->depth * sizeof(struct io_event))) == NULL)) {
+		return -1;
+	}
+	memset(ctx->iocbs, 0, ctx->depth * sizeof(struct iocb));
+	return (int) syscall(__NR_io_setup, ctx->depth, &ctx->aio_ctx);
+}
+
+static int aio_queue(async_ctx_t *ctx, const unsigned int slot, const op_t oper, const OFF_T pos)
+{
+	struct iocb *cb = &ctx->iocbs[slot];
+
+	memset(cb, 0, sizeof(struct iocb));
+	cb->aio_lio_opcode = (oper == WRITER) ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	cb->aio_fildes = ctx->fd;
+	cb->aio_buf = (unsigned long) ctx->iov[slot].iov_base;
+	cb->aio_nbytes = ctx->iov[slot].iov_len;
+	cb->aio_offset = (long long) pos;
+	cb->aio_data = slot;
+
+	ctx->iocbq[ctx->queued] = cb;
+	return 0;
+}
+
+static int aio_submit(async_ctx_t *ctx)
+{
+	int rv;
+	unsigned int done = 0, i;
+
+	while(done < ctx->queued) {
+		rv = (int) syscall(__NR_io_submit, ctx->aio_ctx, (long) (ctx->queued - done), ctx->iocbq + done);
+		if(rv < 0) {
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN) {
+				/* short of resources, keep the rest queued for the caller to reap first */
+				memmove(ctx->iocbq, ctx->iocbq + done, (ctx->queued - done) * sizeof(struct iocb *));
+				ctx->queued -= done;
+				return (int) ctx->queued;
+			}
+			/* the first iocb not accepted was bad, fail it and the rest */
+			for(i = done; i < ctx->queued; i++) {
+				ctx->failed[ctx->nfailed].slot = (unsigned int) ctx->iocbq[i]->aio_data;
+				ctx->failed[ctx->nfailed].result = -errno;
+				ctx->nfailed++;
+			}
+			ctx->queued = 0;
+			return -1;
+		}
+		done += rv;
+	}
+	ctx->queued = 0;
+	return 0;
+}
+
+static int aio_reap(async_ctx_t *ctx, async_event_t *events, unsigned int n, const unsigned int min_nr, const unsigned int max_nr, const OFF_T until)
+{
+	struct timespec ts, *timeout = NULL;
+	OFF_T now;
+	int rv, i;
+
+	if(n >= max_nr) return (int) n;
+	do {
+		if(until != 0) {
+			if((now = getMonoTime()) >= until) now = until;
+			ts.tv_sec = (time_t) ((until - now) / NSECS_PER_SEC);
+			ts.tv_nsec = (long) ((until - now) % NSECS_PER_SEC);
+			timeout = &ts;
+		}
+		rv = (int) syscall(__NR_io_getevents, ctx->aio_ctx, (long) ((min_nr > n) ? min_nr - n : 0), (long) (max_nr - n), ctx->aio_events, timeout);
+	} while((rv < 0) && (errno == EINTR));
+	if(rv < 0) return -1;
+
+	for(i = 0; i < rv; i++) {
+		events[n].slot = (unsigned int) ctx->aio_events[i].data;
+		events[n].result = (long) ctx->aio_events[i].res;
+		n++;
+	}
+	return (int) n;
+}
+
+static void aio_close(async_ctx_t *ctx)
+{
+	if(ctx->aio_ctx) syscall(__NR_io_destroy, ctx->aio_ctx);
+	if(ctx->iocbs) FREE(ctx->iocbs);
+	if(ctx->iocbq) FREE(ctx->iocbq);
+	if(ctx->aio_events) FREE(ctx->aio_events);
+}
+
+#endif /* LINUX */
+
+/*
+ * Creates an async context for fd, using the engine selected in flags,
+ * with room for depth transfers.  Returns NULL on failure, with the
+ * system error left in errno.
+ */
+async_ctx_t *AsyncOpen(fd_t fd, const unsigned int depth, const OFF_T flags)
+{
+#ifdef LINUX
+	async_ctx_t *ctx;
+
+	if((ctx = (async_ctx_t *) ALLOC(sizeof(async_ctx_t))) == NULL) {
+		return NULL;
+	}
+	memset(ctx, 0, sizeof(async_ctx_t));
+	ctx->engine = flags & CLD_FLG_ASYNC;
+	ctx->fd = fd;
+	ctx->depth = depth;
+	ctx->ring_fd = -1;
+
+	if(((ctx->iov = (struct iovec *) ALLOC(depth * sizeof(struct iovec))) == NULL) ||
+	   ((ctx->failed = (async_event_t *) ALLOC(depth * sizeof(async_event_t))) == NULL)) {
+		AsyncClose(ctx);
+		return NULL;
+	}
+
+	if(((ctx->engine == CLD_FLG_URING) ? uring_setup(ctx) : aio_setup(ctx)) < 0) {
+		AsyncClose(ctx);
+		return NULL;
+	}
+	return ctx;
+#else
+	errno = ENOSYS;
+	return NULL;
+#endif
+}
+
+/*
+ * Queues a transfer of len bytes at byte position pos for the given
+ * slot.  Nothing is sent to the device until AsyncSubmit is called.
+ */
+int AsyncQueue(async_ctx_t *ctx, const unsigned int slot, const op_t oper, void *buf, const unsigned long len, const OFF_T pos)
+{
+#ifdef LINUX
+	ctx->iov[slot].iov_base = buf;
+	ctx->iov[slot].iov_len = len;
+	if(((ctx->engine == CLD_FLG_URING) ? uring_queue(ctx, slot, oper, pos) : aio_queue(ctx, slot, oper, pos)) < 0) {
+		return -1;
+	}
+	ctx->queued++;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Sends all queued transfers to the device.  On failure, the transfers
+ * that did not make it are returned as failed events by AsyncReap.
+ * If the kernel pushes back, returns the number still queued, which
+ * should be sent again once completions have been reaped.
+ */
+int AsyncSubmit(async_ctx_t *ctx)
+{
+#ifdef LINUX
+	if(ctx->engine == CLD_FLG_URING) {
+		return uring_submit(ctx);
+	}
+	return aio_submit(ctx);
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Waits for at least min_nr, and returns up to max_nr, completed
+ * transfers.  Returns the number of events or -1 on failure.
+ */
+int AsyncReap(async_ctx_t *ctx, async_event_t *events, const unsigned int min_nr, const unsigned int max_nr)
+{
+#ifdef LINUX
+	unsigned int n = 0;
+
+	while((ctx->nfailed > 0) && (n < max_nr)) {
+		events[n++] = ctx->failed[--ctx->nfailed];
+	}
+	if(ctx->engine == CLD_FLG_URING) {
+		return uring_reap(ctx, events, n, min_nr, max_nr, 0);
+	}
+	return aio_reap(ctx, events, n, min_nr, max_nr, 0);
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Like AsyncReap, but gives up waiting for a completion at until,
+ * nsecs from getMonoTime, so the caller can issue paced transfers.
+ * Returns 0 events on a timeout.
+ */
+int AsyncWait(async_ctx_t *ctx, async_event_t *events, const unsigned int max_nr, const OFF_T until)
+{
+#ifdef LINUX
+	unsigned int n = 0;
+
+	while((ctx->nfailed > 0) && (n < max_nr)) {
+		events[n++] = ctx->failed[--ctx->nfailed];
+	}
+	if(ctx->engine == CLD_FLG_URING) {
+		return uring_reap(ctx, events, n, 1, max_nr, until);
+	}
+	return aio_reap(ctx, events, n, 1, max_nr, until);
+#else
+	return -1;
+#endif
+}
+
+void AsyncClose(async_ctx_t *ctx)
+{
+#ifdef LINUX
+	if(ctx == NULL) return;
+	if(ctx->engine == CLD_FLG_URING) {
+		uring_close(ctx);
+	} else {
+		aio_close(ctx);
+	}
+	if(ctx->iov) FREE(ctx->iov);
+	if(ctx->failed) FREE(ctx->failed);
+	FREE(ctx);
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+#ifndef _ASYNC_H
+#define _ASYNC_H 1
+
+#include "defs.h"
+#include "io.h"
+
+/*
+ * Asynchronous IO engines.  A context is bound to a single fd and has
+ * room for depth outstanding transfers.  Each transfer is identified by
+ * a slot number, chosen by the caller, which is handed back on completion.
+ */
+typedef struct async_ctx async_ctx_t;
+
+typedef struct async_event {
+	unsigned int slot;		/* slot number given to AsyncQueue */
+	long result;			/* bytes transfered, or -errno on failure */
+} async_event_t;
+
+async_ctx_t *AsyncOpen(fd_t, const unsigned int, const OFF_T);
+int AsyncQueue(async_ctx_t *, const unsigned int, const op_t, void *, const unsigned long, const OFF_T);
+int AsyncSubmit(async_ctx_t *);
+int AsyncReap(async_ctx_t *, async_event_t *, const unsigned int, const unsigned int);
+int AsyncWait(async_ctx_t *, async_event_t *, const unsigned int, const OFF_T);
+void AsyncClose(async_ctx_t *);
+
+#endif /* _ASYNC_H */
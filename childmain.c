@@ -48,6 +48,7 @@
 #include <fcntl.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 
 #include "defs.h"
 #include "globals.h"
@@ -55,65 +56,58 @@
 #include "sfunc.h"
 #include "threading.h"
 #include "io.h"
+#include "async.h"
+#include "arena.h"
+#include "pattern.h"
+#include "latency.h"
+#include "rate.h"
 #include "dump.h"
 #include "timer.h"
 #include "signals.h"
 #include "childmain.h"
 
 
+/*
+ * mutex used to keep data miscompare reporting from
+ * interleaving between threads, across all targets
+ */
 #ifdef WINDOWS
-typedef DWORD TIME_T;
-TIME_T gettime (void) {
-    return GetTickCount();
-}
-
-unsigned long get_time_diff(DWORD *endTime, DWORD *startTime) {
-    if((*endTime - *startTime) < 0) return (0);
-    else return((*endTime - *startTime) * 1000); /* since we report in usecs, and windows is msec, multiply by 1000 */
-}
-
-unsigned long assign_time(const TIME_T time) {
-	//printf("Time %u\n", time);
-	return (unsigned long) (time * 1000); /* since we report in usecs, and windows is msec, multiply by 1000 */
-}
+static HANDLE MutexMISCOMP = NULL;
 #else
-typedef struct timeval TIME_T;
-
-TIME_T gettime(void) {
-	TIME_T tv;
-
-    gettimeofday(&tv, NULL);
-	return tv;
-}
-
-unsigned long get_time_diff(struct timeval *tv_end, struct timeval *tv_start) {
-	long time_diff;
-
-	time_diff = (tv_end->tv_sec-tv_start->tv_sec)*1000*1000; // convert seconds to us
-	time_diff += (tv_end->tv_usec - tv_start->tv_usec);
-    return time_diff;
-}
-
-unsigned long assign_time(const TIME_T time) {
-//	printf("Time %lu\n", ((time.tv_sec*1000*1000)+time.tv_usec));
-	return (unsigned long) ((time.tv_sec*1000*1000)+time.tv_usec);
-}
+static pthread_mutex_t MutexMISCOMP = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
+/*
+ * per slot state used by the async IO loop
+ */
+typedef struct io_slot {
+	action_t target;			/* the action being performed by this slot */
+	unsigned char *buffer;		/* 'buf' is the aligned 'buffer' */
+	unsigned char *buf;			/* data buffer handed to the engine */
+	unsigned char *data;		/* data sent by the current action, 'buf' or the shared data buffer */
+	unsigned int retries;		/* retries left for the current action */
+	OFF_T startTime;			/* time the action was submitted, from getMonoTime */
+	OFF_T due;					/* time the -g schedule and -l caps allow the action to be submitted */
+	OFF_T intended;				/* -g arrival time of the action, 0 in a closed loop */
+} io_slot_t;
+
+/* nsecs to back off when the kernel refuses transfers and has none in flight to reap */
+#define ASYNC_BACKOFF	100000
+
 void set_global_start_time(const child_args_t *args, test_env_t *env)
 {
-	TIME_T time;
+	OFF_T time;
+
+	time = getMonoTime();
 
-	time = gettime();
-	
 	if(env->gw_start_time == 0) {
 		if(args->flags & CLD_FLG_W) {
 			if((args->flags & CLD_FLG_LINEAR) && !(args->flags & CLD_FLG_NTRLVD)) {
 				if(TST_OPER(args->test_state) == WRITER) {
-					env->gw_start_time = assign_time(time);
+					env->gw_start_time = time;
 				}
 			} else {
-				env->gw_start_time = assign_time(time);
+				env->gw_start_time = time;
 			}
 		}
 	}
@@ -122,10 +116,10 @@ void set_global_start_time(const child_args_t *args, test_env_t *env)
 		if(args->flags & CLD_FLG_R) {
 			if((args->flags & CLD_FLG_LINEAR) && !(args->flags & CLD_FLG_NTRLVD)) {
 				if(TST_OPER(args->test_state) == READER) {
-					env->gr_start_time = assign_time(time);
+					env->gr_start_time = time;
 				}
 			} else {
-				env->gr_start_time = assign_time(time);
+				env->gr_start_time = time;
 			}
 		}
 	}
@@ -133,18 +127,18 @@ void set_global_start_time(const child_args_t *args, test_env_t *env)
 
 void set_global_stop_time(const child_args_t *args, test_env_t *env)
 {
-	TIME_T time;
+	OFF_T time;
 
-	time = gettime();
+	time = getMonoTime();
 
 	if(env->gw_stop_time == 0) {
 		if(args->flags & CLD_FLG_W) {
 			if((args->flags & CLD_FLG_LINEAR) && !(args->flags & CLD_FLG_NTRLVD)) {
 				if(TST_OPER(args->test_state) == WRITER) {
-					env->gw_stop_time = assign_time(time);
+					env->gw_stop_time = time;
 				}
 			} else {
-				env->gw_stop_time = assign_time(time);
+				env->gw_stop_time = time;
 			}
 		}
 	}
@@ -153,10 +147,10 @@ void set_global_stop_time(const child_args_t *args, test_env_t *env)
 		if(args->flags & CLD_FLG_R) {
 			if((args->flags & CLD_FLG_LINEAR) && !(args->flags & CLD_FLG_NTRLVD)) {
 				if(TST_OPER(args->test_state) == READER) {
-					env->gr_stop_time = assign_time(time);
+					env->gr_stop_time = time;
 				}
 			} else {
-				env->gr_stop_time = assign_time(time);
+				env->gr_stop_time = time;
 			}
 		}
 	}
@@ -164,29 +158,52 @@ void set_global_stop_time(const child_args_t *args, test_env_t *env)
 
 
 /*
- * The following three functions are used to mutex LBAs that are in use by another
- * thread from any other thread performing an action on that lba.
+ * The following functions are used to mutex LBAs that are in use by another
+ * thread from any other thread performing an action on that lba.  Actions in
+ * use are hashed on the region of htrsiz blocks that their first lba falls in,
+ * as no transfer is larger then htrsiz, an action can only overlap with actions
+ * that start in its own regions, or the region before.
  */
-unsigned short action_in_use(const test_env_t *env, const action_t target)
+#define ACTION_REGION(args, lba) ((OFF_T) (lba) / (OFF_T) (args)->htrsiz)
+#define ACTION_BUCKET(env, region) ((unsigned int) (((unsigned long long) (region) * 0x9E3779B97F4A7C15ULL) >> 32) & (env)->action_hash_mask)
+
+void clear_action_list(test_env_t *env, const child_args_t *args)
 {
-	int i = 0;
+	unsigned int i, entries = args->t_kids*args->io_depth;
+
+	memset(env->action_hash,0,sizeof(action_node_t *)*(env->action_hash_mask+1));
+	for(i = 0; i < entries; i++) {
+		env->action_list[i].next = (i+1 < entries) ? &env->action_list[i+1] : NULL;
+	}
+	env->action_free = env->action_list;
+	env->action_list_entry = 0;
+}
 
-	for(i = 0; i < env->action_list_entry; i++) {
-		if((target.lba == env->action_list[i].lba) /* attempting same transfer start lba */
-		|| ((target.lba < env->action_list[i].lba) && (target.lba+target.trsiz-1) >= env->action_list[i].lba) /* attempting transfer over an lba in use */
-		) {
+unsigned short action_in_use(const child_args_t *args, const test_env_t *env, const action_t target)
+{
+	OFF_T region = ACTION_REGION(args, target.lba);
+	OFF_T last = ACTION_REGION(args, target.lba+target.trsiz-1);
+	action_node_t *node;
+
+	if(region > 0) region--;
+	for(; region <= last; region++) {
+		for(node = env->action_hash[ACTION_BUCKET(env, region)]; node != NULL; node = node->next) {
+			if((node->action.lba > (target.lba+target.trsiz-1)) /* starts after our transfer */
+			|| ((node->action.lba+node->action.trsiz-1) < target.lba) /* ends before our transfer */
+			) {
+				continue;
+			}
 			/*
 			 * The lba(s) we want to do IO to are in use by another thread,
 			 * but since POSIX allows for multiple readers, we need to compare
 			 * our action with the action being executed by the other thread
 			 */
 			switch(target.oper) {
-				case WRITER : /* if we want to write, we can't */
-					return TRUE;
-				case READER : /* if we want to read, and a write is in progress, we can't */ 
-					if(env->action_list[i].oper == WRITER) { return TRUE; }
+				case READER : /* if we want to read, and a write is in progress, we can't */
+					if(node->action.oper == WRITER) { return TRUE; }
 					/* otherwise allow multiple readers */
-					return FALSE;
+					break;
+				case WRITER : /* if we want to write, we can't */
 				default:
 					/* for all other operations, always assume inuse */
 					return TRUE;
@@ -199,18 +216,25 @@ unsigned short action_in_use(const test_env_t *env, const action_t target)
 
 void add_action(test_env_t *env, const child_args_t *args, const action_t target)
 {
+	action_node_t *node = env->action_free;
+	unsigned int bucket;
 
-	if(env->action_list_entry == args->t_kids) { /* we should never get here */
+	if(node == NULL) { /* we should never get here */
 		printf("ATTEMPT TO ADD MORE ENTRIES TO LBA WRITE LIST THEN ALLOWED, CODE BUG!!!\n");
 		abort();
 	}
 
-	env->action_list[env->action_list_entry++] = target;
+	env->action_free = node->next;
+	bucket = ACTION_BUCKET(env, ACTION_REGION(args, target.lba));
+	node->action = target;
+	node->next = env->action_hash[bucket];
+	env->action_hash[bucket] = node;
+	env->action_list_entry++;
 }
 
-void remove_action(test_env_t *env, const action_t target)
+void remove_action(test_env_t *env, const child_args_t *args, const action_t target)
 {
-	int i = 0;
+	action_node_t **link, *node;
 
 	if(env->action_list_entry == 0) {
 		/* we should never get here */
@@ -219,31 +243,63 @@ void remove_action(test_env_t *env, const action_t target)
 	}
 
 	/* look for the removing target */
-	while(target.lba != env->action_list[i].lba) {
-		if(env->action_list_entry == i++) {
-			printf("INDEX AND CURRENT LIST ENTRY, CODE BUG!!!!!!\n");
-			abort();
-		}
+	link = &env->action_hash[ACTION_BUCKET(env, ACTION_REGION(args, target.lba))];
+	while((*link != NULL)
+		&& (((*link)->action.lba != target.lba) || ((*link)->action.trsiz != target.trsiz) || ((*link)->action.oper != target.oper))) {
+		link = &(*link)->next;
 	}
-
-	/* move eny other entries down */
-	for(;i < env->action_list_entry-1; i++) {
-		env->action_list[i] = env->action_list[i+1];
+	if(*link == NULL) {
+		printf("INDEX AND CURRENT LIST ENTRY, CODE BUG!!!!!!\n");
+		abort();
 	}
 
-	/* reduce the slot */
+	/* unlink the entry and give it back to the free list */
+	node = *link;
+	*link = node->next;
+	node->next = env->action_free;
+	env->action_free = node;
+
 	env->action_list_entry--;
 }
 
+/*
+ * called holding MutexACTION, whenever an action in use is released or
+ * blocks are marked written, to wake up threads that were told to RETRY
+ */
+void release_action(test_env_t *env)
+{
+	ATOMIC_ADD(&(env->action_release), 1);
+	if(env->action_waiters > 0) {
+		COND_BROADCAST(env->mutexs.CondACTION);
+	}
+}
+
+/*
+ * called when a thread was told to RETRY, rather then spinning on
+ * MutexACTION, wait for another thread to release an action
+ */
+void wait_for_release(test_env_t *env, const child_ctx_t *ctx)
+{
+	LOCK(env->mutexs.MutexACTION);
+	/* count ourselves as waiting before checking, see complete_io */
+	ATOMIC_ADD(&(env->action_waiters), 1);
+	if(env->bContinue && (ctx->release == env->action_release)) {
+		COND_WAIT(env->mutexs.CondACTION, env->mutexs.MutexACTION, ACTION_WAIT_MSEC);
+	}
+	ATOMIC_ADD(&(env->action_waiters), -1);
+	UNLOCK(env->mutexs.MutexACTION);
+}
+
 void decrement_io_count(const child_args_t *args, test_env_t *env, const action_t target)
 {
 	if(args->flags & CLD_FLG_LBA_SYNC) { 
-		remove_action(env, target);
+		remove_action(env, args, target);
+		release_action(env);
 	}
 	if(target.oper == WRITER) {
-		(env->wcount)--;
+		ATOMIC_ADD(&(env->wcount), -1);
 	} else {
-		(env->rcount)--;
+		ATOMIC_ADD(&(env->rcount), -1);
 	}
 }
 
@@ -253,17 +309,10 @@ void decrement_io_count(const child_args_t *args, test_env_t *env, const action_
  * is so a trigger can be set, i.e. on an analyser.
  */
 void write_error_mark(fd_t fd, unsigned char *data) {
-	OFF_T ActualBytePos=0;
 	long tcnt=0;
 
-	ActualBytePos = Seek(fd, 0);
-	if(ActualBytePos != 0) {
-		/* could not seek to LBA 0 */
-		return;
-	}
-
 	memcpy(data, "DISKTEST ERROR OCCURRED", strlen("DISKTEST ERROR OCCURRED"));
-	tcnt = Write(fd, data, BLK_SIZE);
+	tcnt = WriteAt(fd, data, BLK_SIZE, 0);
 }
 
 /*
@@ -297,6 +346,55 @@ void update_test_state(child_args_t *args, test_env_t *env, const int this_threa
 	}
 }
 
+/*
+ * The write bitmap has a bit for every ltrsiz blocks.  These work on
+ * the bits covering target a word at a time, mark_written sets them
+ * with an atomic or, so completions do not need MutexACTION.
+ */
+#define BMP_BIT(args, lba) (((lba)-(args)->offset-(args)->start_lba)/(OFF_T) (args)->ltrsiz)
+
+bmp_word_t bmp_mask(const OFF_T first, const OFF_T last, const OFF_T word)
+{
+	bmp_word_t mask = ~((bmp_word_t) 0);
+
+	if(word == (first / BMP_WORD_BITS)) {
+		mask &= mask << (first % BMP_WORD_BITS);
+	}
+	if(word == (last / BMP_WORD_BITS)) {
+		mask &= ~((bmp_word_t) 0) >> ((BMP_WORD_BITS - 1) - (last % BMP_WORD_BITS));
+	}
+	return mask;
+}
+
+void mark_written(const child_args_t *args, test_env_t *env, const action_t target)
+{
+	bmp_word_t *wbitmap = (bmp_word_t *) ((unsigned char *)env->shared_mem + BMP_OFFSET);
+	OFF_T first = BMP_BIT(args, target.lba);
+	OFF_T last = first + ((target.trsiz + args->ltrsiz - 1) / args->ltrsiz) - 1;
+	OFF_T word;
+
+	for(word = first / BMP_WORD_BITS; word <= last / BMP_WORD_BITS; word++) {
+		ATOMIC_OR(wbitmap+word, bmp_mask(first, last, word));
+	}
+}
+
+BOOL is_written(const child_args_t *args, const test_env_t *env, const action_t target)
+{
+	volatile bmp_word_t *wbitmap = (bmp_word_t *) ((unsigned char *)env->shared_mem + BMP_OFFSET);
+	OFF_T first = BMP_BIT(args, target.lba);
+	OFF_T last = first + ((target.trsiz + args->ltrsiz - 1) / args->ltrsiz) - 1;
+	OFF_T word;
+	bmp_word_t mask;
+
+	for(word = first / BMP_WORD_BITS; word <= last / BMP_WORD_BITS; word++) {
+		mask = bmp_mask(first, last, word);
+		if((wbitmap[word] & mask) != mask) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
 #ifdef _DEBUG
 #ifdef _DEBUG_PRINTMAP
 void print_lba_bitmap(const test_env_t *env)
@@ -312,17 +410,52 @@ void print_lba_bitmap(const test_env_t *env)
 #endif
 #endif
 
-action_t get_next_action(child_args_t *args, test_env_t *env, const OFF_T mask)
+/*
+ * Picks the random transfer size and random lba for the next action,
+ * using this thread's generator.  This is done before MutexACTION is
+ * taken, get_next_action will use them if it needs them.
+ */
+void pick_random_action(const child_args_t *args, child_ctx_t *ctx)
+{
+	OFF_T guessLBA;
+	action_t target = { NONE, 0, 0 };
+
+	/* pick a transfer length, a multiple of ltrsiz up to htrsiz */
+	if(!(args->flags & CLD_FLG_RTRSIZ)) {
+		target.trsiz = args->ltrsiz;
+	} else {
+		target.trsiz = args->ltrsiz * (1 + (unsigned long) RandRange(&ctx->rand_state, args->htrsiz / args->ltrsiz));
+	}
+
+	/* pick an lba, from start_lba to stop_lba */
+	if(args->flags & CLD_FLG_RANDOM) {
+		target.lba = args->start_lba + (OFF_T) RandRange(&ctx->rand_state, (unsigned long long) (args->stop_lba - args->start_lba) + 1);
+
+		guessLBA = ALIGN(target.lba, target.trsiz)+args->offset;
+		if(guessLBA > args->stop_lba) { target.lba = guessLBA = args->stop_lba; }
+		if(target.lba != guessLBA) {
+			if((target.lba - guessLBA) <= ((guessLBA + target.trsiz) - target.lba)) {
+				target.lba = guessLBA;
+			} else if ((guessLBA + target.trsiz) > args->stop_lba) {
+				target.lba = guessLBA;
+			} else {
+				target.lba = guessLBA + target.trsiz;
+			}
+		}
+		if((target.lba+(target.trsiz-1)) > args->stop_lba) { target.lba -= target.trsiz; }
+	}
+
+	ctx->rnd = target;
+}
+
+action_t get_next_action(child_args_t *args, test_env_t *env, const child_ctx_t *ctx)
 {
 	
 	OFF_T *p_tmp_LBA;
-	OFF_T guessLBA;
-	unsigned char *wbitmap = (unsigned char *)env->shared_mem + BMP_OFFSET;
 
 	short blk_written = 0;
 	action_t target = { NONE, 0, 0 };
 	short direct = 0;
-	unsigned long i;
 
 	/* pick an operation */
 	target.oper = env->lastAction.oper;
@@ -357,12 +490,7 @@ action_t get_next_action(child_args_t *args, test_env_t *env, const OFF_T mask)
 				(target.oper == READER)) {
 			target.trsiz = env->lastAction.trsiz;
 		} else {
-			do {
-				target.trsiz = (rand()&0xFFF);
-				target.trsiz += target.trsiz%args->ltrsiz;
-				if((args->flags & CLD_FLG_SKS) && (((env->wcount)+(env->rcount)) >= args->seeks))
-					break;
-			} while(target.trsiz > args->htrsiz);
+			target.trsiz = ctx->rnd.trsiz;
 		}
 	}
 
@@ -407,25 +535,10 @@ action_t get_next_action(child_args_t *args, test_env_t *env, const OFF_T mask)
 		  && (target.oper == READER)) {
 			target.lba = env->lastAction.lba;
 		} else {
-			do {
-				target.lba = (Rand64()&mask) + args->start_lba;
-			} while(target.lba > args->stop_lba);
-
-			guessLBA = ALIGN(target.lba, target.trsiz)+args->offset;
-			if(guessLBA > args->stop_lba) { target.lba = guessLBA = args->stop_lba; }
-			if(target.lba != guessLBA) {
-				if((target.lba - guessLBA) <= ((guessLBA + target.trsiz) - target.lba)) {
-					target.lba = guessLBA;
-				} else if ((guessLBA + target.trsiz) > args->stop_lba) {
-					target.lba = guessLBA;
-				} else {
-					target.lba = guessLBA + target.trsiz;
-				}
-			}
-			if((target.lba+(target.trsiz-1)) > args->stop_lba) { target.lba -= target.trsiz; }
+			target.lba = ctx->rnd.lba;
 		}
 	}
-	if((args->flags & CLD_FLG_LBA_SYNC) && (action_in_use(env, target))) {
+	if((args->flags & CLD_FLG_LBA_SYNC) && (action_in_use(args, env, target))) {
 		target.oper = RETRY;
 	}
 
@@ -453,12 +566,7 @@ action_t get_next_action(child_args_t *args, test_env_t *env, const OFF_T mask)
 	 */
 	blk_written = 1;
 	if(args->flags & (CLD_FLG_CMPR|CLD_FLG_WRITE_ONCE)) {
-		for(i=0;i<target.trsiz;i+=args->ltrsiz) {
-			if((*(wbitmap+(((target.lba-args->offset-args->start_lba+i)/args->ltrsiz)/8))&(0x80>>(((target.lba-args->offset-args->start_lba+i)/args->ltrsiz)%8))) == 0) {
-				blk_written = 0;
-				break;
-			}
-		}
+		blk_written = is_written(args, env, target);
 	}
 
 	/* get out, nothing to do */
@@ -498,7 +606,7 @@ action_t get_next_action(child_args_t *args, test_env_t *env, const OFF_T mask)
 		target.oper = WRITER;
 		args->test_state = SET_OPER_W(args->test_state);
 		/* if we switched to a writer, then we have to check action_in_use again */
-		if((args->flags & CLD_FLG_LBA_SYNC) && (action_in_use(env, target))) {
+		if((args->flags & CLD_FLG_LBA_SYNC) && (action_in_use(args, env, target))) {
 			target.oper = RETRY;
 		}
 	} else {
@@ -541,6 +649,91 @@ action_t get_next_action(child_args_t *args, test_env_t *env, const OFF_T mask)
 	return target;
 }
 
+/*
+ * Lock free version of get_next_action, used when every thread does the
+ * same operation with a fixed transfer size, see CLD_FLG_LBA_DISP.  The
+ * operation count doubles as a ticket, which maps to the next LBA, so
+ * the threads never wait on each other to pick an action.
+ */
+action_t dispense_action(const child_args_t *args, test_env_t *env, child_ctx_t *ctx)
+{
+	action_t target = ctx->pending;
+	OFF_T *pcount, count, limit = -1, other, first, slots;
+
+	if(target.oper == NONE) {
+		target.oper = TST_OPER(args->test_state);
+		target.trsiz = args->ltrsiz;
+		pcount = (target.oper == WRITER) ? &(env->wcount) : &(env->rcount);
+		other = (target.oper == WRITER) ? env->rcount : env->wcount;
+
+		/* the same limits as get_next_action */
+		if(!(args->flags & CLD_FLG_RANDOM) && (args->flags & CLD_FLG_W) && (args->flags & CLD_FLG_R)) {
+			limit = args->seeks/2;
+		}
+		if((args->flags & CLD_FLG_SKS) && ((limit < 0) || ((args->seeks - other) < limit))) {
+			limit = args->seeks - other;
+		}
+
+		count = ATOMIC_ADD(pcount, 1);
+		if((limit >= 0) && (count >= limit)) {
+			ATOMIC_ADD(pcount, -1);
+			target.oper = NONE;
+			return target;
+		}
+
+		first = args->start_lba + args->offset;
+		if(args->start_blk == args->stop_blk) { /* diskcache test */
+			target.lba = first;
+		} else if (args->flags & CLD_FLG_SWEEP) {
+			target.lba = (count & 1) ? first : args->stop_lba - (target.trsiz-1);
+		} else {
+			slots = ((args->stop_lba - first) + 1) / (OFF_T) target.trsiz;
+			if(slots < 1) slots = 1;
+			if((count >= slots) && (args->flags & CLD_FLG_CYC) && (target.oper == WRITER)) {
+				ATOMIC_ADD(pcount, -1);
+				target.oper = NONE;
+				return target;
+			}
+			target.lba = first + ((count % slots) * (OFF_T) target.trsiz);
+		}
+	}
+
+	/* linear reads must wait for the blocks to be written */
+	if((args->flags & CLD_FLG_LINEAR) && (target.oper == READER) && (args->flags & CLD_FLG_CMPR) && (args->flags & CLD_FLG_W)
+		&& !is_written(args, env, target)) {
+		/* hold on to the ticket, and retry it next time */
+		ctx->pending = target;
+		target.oper = RETRY;
+		return target;
+	}
+
+	ctx->pending.oper = NONE;
+	return target;
+}
+
+/*
+ * Gets the next action for a thread.  Only the parts that need
+ * shared state are done while holding MutexACTION.
+ */
+action_t next_action(child_args_t *args, test_env_t *env, child_ctx_t *ctx)
+{
+	action_t target = { NONE, 0, 0 };
+
+	ctx->release = env->action_release;
+	if(args->flags & CLD_FLG_LBA_DISP) {
+		return dispense_action(args, env, ctx);
+	}
+
+	if(args->flags & (CLD_FLG_RANDOM|CLD_FLG_RTRSIZ)) {
+		pick_random_action(args, ctx);
+	}
+	LOCK(env->mutexs.MutexACTION);
+	target = get_next_action(args, env, ctx);
+	UNLOCK(env->mutexs.MutexACTION);
+
+	return target;
+}
+
 void miscompare_dump(const child_args_t *args, const unsigned char *data, const size_t buf_len, OFF_T tPosition, const size_t offset, mc_func_t oper, const int this_thread_id)
 {
 	FILE *fpDumpFile;
@@ -555,7 +748,7 @@ void miscompare_dump(const child_args_t *args, const unsigned char *data, const
 		if(fpDumpFile) fprintf(fpDumpFile, "Execution string: %s\n", args->argstr);
 		if(fpDumpFile) fprintf(fpDumpFile, "Target: %s\n", args->device);
 		if(fpDumpFile) fprintf(fpDumpFile, DMSTR, this_thread_id, tPosition, tPosition);
-		if(fpDumpFile) fprintf(fpDumpFile, DMOFFSTR, this_thread_id, offset, offset);
+		if(fpDumpFile) fprintf(fpDumpFile, DMOFFSTR, this_thread_id, (unsigned long) offset, (unsigned long) offset);
 		pMsg(ERR, args, "EXPECTED:\n");
 		if(fpDumpFile) fprintf(fpDumpFile, DMFILESTR, "EXPECTED", args->device, tPosition, offset);
 	} else if(oper == ACT) {
@@ -575,35 +768,22 @@ void miscompare_dump(const child_args_t *args, const unsigned char *data, const
  * called after all the checks have been made to verify
  * that the io completed successfully.
  */
-void complete_io(test_env_t *env, const child_args_t *args, const action_t target, unsigned int time_diff)
+void complete_io(test_env_t *env, const child_args_t *args, child_ctx_t *ctx, const action_t target, const OFF_T latency)
 {
-	unsigned char *wbitmap = (unsigned char *)env->shared_mem + BMP_OFFSET;
-	unsigned long i = 0;
-
 	switch (target.oper) {
 		case WRITER : {
-			LOCK(env->mutexs.MutexSTATS);
-			(env->hbeat_stats.wbytes) += target.trsiz*BLK_SIZE;
-			env->hbeat_stats.wcount++;
-			UNLOCK(env->mutexs.MutexSTATS);
-
-			/* Note: This will only update the lengths of ltrsiz. In the case of random
-			 * transfers lengths, only the length divisable by ltrsiz are updated
-			 */
+			ctx->stats->wbytes += target.trsiz*BLK_SIZE;
+			ctx->stats->wcount++;
+			LatencyRecord(&ctx->lat[WRITER], latency);
 			if(args->flags & (CLD_FLG_CMPR|CLD_FLG_WRITE_ONCE)) {
-				LOCK(env->mutexs.MutexACTION);
-				for(i=0;i<target.trsiz;i+=args->ltrsiz) {
-					*(wbitmap+(((target.lba-args->offset-args->start_lba+i)/args->ltrsiz)/8)) |= 0x80>>(((target.lba-args->offset-args->start_lba+i)/args->ltrsiz)%8);
-				}
-				UNLOCK(env->mutexs.MutexACTION);
+				mark_written(args, env, target);
 			}
 			break;
 		}
 		case READER : {
-			LOCK(env->mutexs.MutexSTATS);
-			(env->hbeat_stats.rbytes) += target.trsiz*BLK_SIZE;
-			env->hbeat_stats.rcount++;
-			UNLOCK(env->mutexs.MutexSTATS);
+			ctx->stats->rbytes += target.trsiz*BLK_SIZE;
+			ctx->stats->rcount++;
+			LatencyRecord(&ctx->lat[READER], latency);
 			break;
 		}
 		default : break;
@@ -611,128 +791,379 @@ void complete_io(test_env_t *env, const child_args_t *args, const action_t targe
 
 	if(args->flags & CLD_FLG_LBA_SYNC) {
 		LOCK(env->mutexs.MutexACTION);
-		remove_action(env, target);
+		remove_action(env, args, target);
+		release_action(env);
 		UNLOCK(env->mutexs.MutexACTION);
+	} else if((target.oper == WRITER) && (args->flags & (CLD_FLG_CMPR|CLD_FLG_WRITE_ONCE))) {
+		/* readers may be waiting on the blocks just marked written */
+		ATOMIC_ADD(&(env->action_release), 1);
+		if(env->action_waiters > 0) {
+			LOCK(env->mutexs.MutexACTION);
+			COND_BROADCAST(env->mutexs.CondACTION);
+			UNLOCK(env->mutexs.MutexACTION);
+		}
 	}
 }
 
 /*
-* This function is really the main function for a thread
-* Once here, this function will act as if it
-* were 'main' for that thread.
-*/
-#ifdef WINDOWS
-DWORD WINAPI ChildMain(test_ll_t *test)
-#else
-void *ChildMain(void *vtest)
-#endif
+ * key for the random pattern, -z, so each pass writes different data
+ */
+#define RAND_KEY(args, env) ((((OFF_T) (args)->seed) << 32) ^ (OFF_T) (env)->pass_count)
+
+/*
+ * fills buf with the data that is expected to be at target, either
+ * to be written, or to be compared against what was read back.
+ */
+void fill_io_buffer(unsigned char *buf, const action_t target, const child_args_t *args, const test_env_t *env)
 {
-#ifndef WINDOWS
-	test_ll_t *test = (test_ll_t *)vtest;
-#endif
+	OFF_T lba = target.lba;
 
-	child_args_t *args = test->args;
-	test_env_t *env = test->env;
+	if(args->flags & CLD_FLG_LPTYPE) {
+		fill_buffer(buf, target.trsiz, &lba, sizeof(OFF_T), CLD_FLG_LPTYPE);
+	} else if(args->flags & CLD_FLG_RPTYPE) {
+		PatternFillRandom(buf, target.trsiz, RAND_KEY(args, env), lba, args->rand_len, args->start_lba, args->dedupe_chunks);
+	} else {
+		memcpy(buf, env->data_buffer, target.trsiz*BLK_SIZE);
+	}
+	if(args->flags & CLD_FLG_MBLK) {
+		mark_buffer(buf, target.trsiz*BLK_SIZE, &lba, args, env);
+	}
+}
 
-	static int thread_id = 0;
-	int this_thread_id = thread_id++;
-	unsigned char *buf1 = NULL, *buffer1 = NULL; /* 'buf' is the aligned 'buffer' */
-	unsigned char *buf2 = NULL, *buffer2 = NULL; /* 'buf' is the aligned 'buffer' */
-	unsigned long ulLastError;
-	unsigned long delayTime;
+/*
+ * returns the data to write to target.  Unmarked fixed and counting
+ * patterns are written straight from the shared data buffer, which is
+ * not changed once filled, anything else is built in buf.
+ */
+unsigned char *write_data(unsigned char *buf, const action_t target, const child_args_t *args, const test_env_t *env)
+{
+	if(!(args->flags & (CLD_FLG_LPTYPE|CLD_FLG_RPTYPE|CLD_FLG_MBLK))) {
+		return env->data_buffer;
+	}
+	fill_io_buffer(buf, target, args, env);
+	return buf;
+}
 
-	action_t target = { NONE, 0, 0 };
-	unsigned int i;
-	OFF_T ActualBytePos=0, TargetBytePos=0, mask=1, delayMask=1;
-	long tcnt=0;
-	int exit_code=0, rv=0;
-	char filespec[DEV_NAME_LEN];
-	fd_t fd;
+/*
+ * compares the first len bytes of rbuf, read from target, with the data
+ * expected there.  Each block is checked straight against the data buffer,
+ * or the LBA pattern, with only its mark header built aside, so reads no
+ * longer need an expected data buffer.  With a CRC in the mark, -mc, only
+ * the header of a whole LBA is compared, and its CRC is checked for the
+ * rest.  Returns the offset of the first byte that differs, or of the CRC
+ * that failed, or len if they all match.
+ */
+size_t verify_io_buffer(const unsigned char *rbuf, const size_t len, const action_t target, const child_args_t *args, const test_env_t *env)
+{
+	OFF_T blk[BLK_SIZE/sizeof(OFF_T)];	/* OFF_T keeps the marked fields aligned */
+	unsigned char *ebuf = (unsigned char *) blk;
+	const unsigned char *exp;
+	size_t hdr_len = mark_length(args);
+	size_t off, blk_len, rand_len, n, i;
+	OFF_T lba = target.lba;
+	BOOL crc;
+
+	for(off=0;off<len;off+=BLK_SIZE,lba++) {
+		blk_len = ((len-off) < BLK_SIZE) ? (len-off) : BLK_SIZE;
+		crc = ((args->flags & CLD_FLG_MRK_CRC) && (blk_len == BLK_SIZE)) ? TRUE : FALSE;
+		if(args->flags & CLD_FLG_LPTYPE) {
+			PatternFillLBA(ebuf, 1, lba);
+			exp = ebuf;
+		} else if(args->flags & CLD_FLG_RPTYPE) {
+			/* when the CRC is checked, only the random data under the header is needed */
+			rand_len = args->rand_len;
+			if(crc && (hdr_len < rand_len)) {
+				rand_len = (hdr_len+sizeof(OFF_T)-1) & ~(sizeof(OFF_T)-1);
+			}
+			PatternFillRandom(ebuf, 1, RAND_KEY(args, env), lba, rand_len, args->start_lba, args->dedupe_chunks);
+			exp = ebuf;
+		} else {
+			exp = env->data_buffer + off;
+		}
+		if((args->flags & CLD_FLG_MRK_CRC) && !crc) {
+			/* part of an LBA, its CRC can only be made from the whole expected LBA */
+			if(exp != ebuf) { memcpy(ebuf, exp, BLK_SIZE); }
+			mark_buffer(ebuf, BLK_SIZE, &lba, args, env);
+			if((i = PatternCompare(rbuf+off, ebuf, blk_len)) < blk_len) {
+				return off+i;
+			}
+			continue;
+		}
+		n = 0;
+		if(hdr_len > 0) {
+			if(exp != ebuf) { memcpy(ebuf, exp, hdr_len); }
+			mark_buffer(ebuf, hdr_len, &lba, args, env);
+			n = (hdr_len < blk_len) ? hdr_len : blk_len;
+			if((i = PatternCompare(rbuf+off, ebuf, n)) < n) {
+				return off+i;
+			}
+		}
+		if(crc) {
+			if(!mark_crc_valid(rbuf+off)) {
+				return off+MARK_CRC_OFF;
+			}
+			continue;
+		}
+		if((i = n + PatternCompare(rbuf+off+n, exp+n, blk_len-n)) < blk_len) {
+			return off+i;
+		}
+	}
+	return len;
+}
 
-	unsigned int retries = 0;
-	BOOL is_retry = FALSE;
-	lvl_t msg_level = WARN;
-	int SET_CHAR = 0; /* when data buffers are cleared, using memset, use this */
-	unsigned int time_diff = 0;
+/*
+ * Delay delayTime msecs before continuing, for simulated
+ * processing time, requested by user
+ */
+void io_delay(const child_args_t *args, child_ctx_t *ctx, const int this_thread_id)
+{
+	unsigned long delayTime;
 
-#ifdef WINDOWS
-	DWORD startTime;
-	DWORD endTime;
-#else
-	struct timeval startTime; struct timeval endTime;
+	if(args->delayTimeMin == args->delayTimeMax) { /* static delay time */
+		/* only sleep if delay is greater then zero */
+		if(args->delayTimeMin > 0) { Sleep(args->delayTimeMin); }
+	} else { /* random delay time between min & max */
+		delayTime = args->delayTimeMin + (unsigned long) RandRange(&ctx->rand_state, (unsigned long long) (args->delayTimeMax - args->delayTimeMin) + 1);
+#ifdef _DEBUG
+		PDBG3(DBUG, args, "Thread %d: Delay time = %lu\n", this_thread_id, delayTime);
 #endif
+		Sleep(delayTime);
+	}
+}
 
-	extern unsigned long  glb_flags;
-	extern unsigned short glb_run;
-	extern int signal_action;
+/*
+ * takes the tokens for target from the -l buckets, both the ones for
+ * all IO and the ones for its operation, as of after, and returns when
+ * it may be issued, from getMonoTime
+ */
+OFF_T io_pace(const child_args_t *args, test_env_t *env, const action_t target, const OFF_T after)
+{
+	OFF_T now, due, when;
+	OFF_T bytes = (OFF_T) target.trsiz*BLK_SIZE;
+
+	now = getMonoTime();
+	if(after > now) now = after;
+	due = RateTake(&env->rate[RATE_IOPS(RATE_ALL)], 1, now);
+	if((when = RateTake(&env->rate[RATE_BW(RATE_ALL)], bytes, now)) > due) due = when;
+	if((when = RateTake(&env->rate[RATE_IOPS(target.oper)], 1, now)) > due) due = when;
+	if((when = RateTake(&env->rate[RATE_BW(target.oper)], bytes, now)) > due) due = when;
+	return due;
+}
 
-#ifdef WINDOWS
-	HANDLE MutexMISCOMP;
+/*
+ * takes the next arrival from the -g schedule.  Poisson gaps are drawn
+ * from the thread's random stream, so a seed repeats the schedule.
+ */
+OFF_T io_arrival(const child_args_t *args, test_env_t *env, child_ctx_t *ctx)
+{
+	double gap = 1.0;
 
-	if((MutexMISCOMP = OpenMutex(SYNCHRONIZE, TRUE, "gbl")) == NULL) {
-		pMsg(ERR, args, "Thread %d: Failed to open semaphore, error = %u\n", this_thread_id, GetLastError());
-		args->test_state = SET_STS_FAIL(args->test_state);
-		glb_flags |= GLB_FLG_FAILED;
-		TEXIT(GETLASTERROR());
+	if(args->flags & CLD_FLG_POISSON) {
+		/* exponential gap with a mean of 1, U is in [0,1) */
+		gap = -log(1.0 - (double) (RandNext(&ctx->rand_state) >> 11) / 9007199254740992.0);
 	}
-#else
-	static pthread_mutex_t MutexMISCOMP = PTHREAD_MUTEX_INITIALIZER; 
-#endif
+	return RateArrival(&env->arrival, gap, getMonoTime());
+}
 
-	/*
-	 * For some messages, the error level will change, based on if
-	 * the test should continue on error, or stop on error.
-	 */
-	if((args->flags & CLD_FLG_ALLDIE) || (glb_flags & GLB_FLG_KILL)) {
-		msg_level = ERR;
-	}
+/*
+ * returns when target may be issued, from getMonoTime: its -g arrival,
+ * held back as far as the -l caps need.  intended is set to the arrival,
+ * which open loop latency is measured from, or 0 in a closed loop.
+ */
+OFF_T io_schedule(const child_args_t *args, test_env_t *env, child_ctx_t *ctx, const action_t target, OFF_T *intended)
+{
+	OFF_T due = 0, when;
 
-	target.oper = TST_OPER(args->test_state);
+	*intended = 0;
+	if((target.oper != WRITER) && (target.oper != READER)) return 0;
+	if(args->flags & CLD_FLG_OPEN) { due = *intended = io_arrival(args, env, ctx); }
+	if((args->flags & CLD_FLG_RATE) && ((when = io_pace(args, env, target, due)) > due)) { due = when; }
+	return due;
+}
 
-	strncpy(filespec, args->device, DEV_NAME_LEN);
+/*
+ * if the write sync interval has been reached, sync the target.  Only
+ * one thread will do the sync, others are forced to wait.  Returns the
+ * error from the sync, in which case the write should not be counted.
+ */
+int sync_write(child_args_t *args, test_env_t *env, fd_t fd, const action_t target, unsigned char *data, const int this_thread_id, const lvl_t msg_level)
+{
+	int rv = 0, exit_code = 0;
 
-	fd = Open(filespec, args->flags);
-	if(INVALID_FD(fd)) {
-		pMsg(ERR, args, "Thread %d: could not open %s, errno = %u.\n", this_thread_id,args->device, GETLASTERROR());
-		args->test_state = SET_STS_FAIL(args->test_state);
-		glb_flags |= GLB_FLG_FAILED;
-		TEXIT(GETLASTERROR());
-	}
+	LOCK(env->mutexs.MutexACTION);
+	if(0 == (env->wcount % args->sync_interval)) {
+#ifdef _DEBUG
+		PDBG3(DBUG, args, "Thread %d: Performing sync, write IO count %llu\n", this_thread_id, env->wcount);
+#endif
+		rv = Sync(fd);
+		if(0 != rv) {
+			exit_code = GETLASTERROR();
+			pMsg(msg_level, args, "Thread %d: fsync error = %d\n", this_thread_id, exit_code);
+			update_test_state(args, env, this_thread_id, fd, data);
+			decrement_io_count(args, env, target);
+		}
+	}
+	UNLOCK(env->mutexs.MutexACTION);
 
-	/* Create aligned memory buffers for sending IO. */
-	if ((buffer1 = (unsigned char *) ALLOC(((args->htrsiz*BLK_SIZE)+ALIGNSIZE))) == NULL) {
-		pMsg(ERR, args, "Thread %d: Memory allocation failure for IO buffer, errno = %u\n", this_thread_id, GETLASTERROR());
-		args->test_state = SET_STS_FAIL(args->test_state);
-		glb_flags |= GLB_FLG_FAILED;
-		CLOSE(fd);
-		TEXIT(GETLASTERROR());
+	return exit_code;
+}
+
+/*
+ * data compare routine.  Checks what was read in rbuf against the data
+ * expected at target.  On a miscompare, ebuf is used to build the expected
+ * data, which is dumped, and the target is reread if requested.  Returns
+ * FALSE on a data miscompare.
+ */
+BOOL verify_data(child_args_t *args, const test_env_t *env, fd_t fd, const action_t target, unsigned char *rbuf, unsigned char *ebuf, const int this_thread_id)
+{
+	long tcnt=0;
+	size_t i, off, len, n, blocks = 0, bytes = 0;
+	int SET_CHAR = 0; /* when data buffers are cleared, using memset, use this */
+
+	if((args->cmp_lng == 0) || (args->cmp_lng > target.trsiz*BLK_SIZE)) {
+		args->cmp_lng = target.trsiz*BLK_SIZE;
+	}
+	i = verify_io_buffer(rbuf, args->cmp_lng, target, args, env);
+	if(i == args->cmp_lng) {
+		return TRUE;
 	}
-	memset(buffer1, SET_CHAR, ((args->htrsiz*BLK_SIZE)+ALIGNSIZE));
-	buf1 = (unsigned char *) BUFALIGN(buffer1);
 
-	if ((buffer2 = (unsigned char *) ALLOC(((args->htrsiz*BLK_SIZE)+ALIGNSIZE))) == NULL) {
-		pMsg(ERR, args, "Thread %d: Memory allocation failure for IO buffer, errno = %u\n", this_thread_id, GETLASTERROR());
-		FREE(buffer1);
-		args->test_state = SET_STS_FAIL(args->test_state);
-		glb_flags |= GLB_FLG_FAILED;
-		CLOSE(fd);
-		TEXIT(GETLASTERROR());
+	/*
+	 * data miscompare, build the expected data and count the damage
+	 * before taking MutexMISCOMP, so other threads are only held up
+	 * while this one reports
+	 */
+	fill_io_buffer(ebuf, target, args, env);
+	if(args->flags & CLD_FLG_MRK_CRC) {
+		/* a failed CRC only tells which LBA is bad, so find the byte */
+		i = PatternCompare(rbuf, ebuf, args->cmp_lng);
+	}
+	for(off=0;off<args->cmp_lng;off+=BLK_SIZE) {
+		len = ((args->cmp_lng-off) < BLK_SIZE) ? (args->cmp_lng-off) : BLK_SIZE;
+		if((n = PatternCountDiff(rbuf+off, ebuf+off, len)) > 0) {
+			blocks++;
+			bytes += n;
+		}
 	}
-	memset(buffer2, SET_CHAR, ((args->htrsiz*BLK_SIZE)+ALIGNSIZE));
-	buf2 = (unsigned char *) BUFALIGN(buffer2);
 
-	/*  set up lba mask of all 1's with value between vsiz and 2*vsiz */
-	while(mask <= (args->stop_lba - args->start_lba)) { mask = mask<<1; }
-	mask -= 1;
+	LOCK(MutexMISCOMP);
+	pMsg(ERR, args, DMSTR, this_thread_id, target.lba, target.lba);
+	pMsg(ERR, args, DMOFFSTR, this_thread_id, (unsigned long) i, (unsigned long) i);
+	pMsg(ERR, args, DMCNTSTR, this_thread_id, (unsigned long) blocks, (unsigned long) ((args->cmp_lng+BLK_SIZE-1)/BLK_SIZE), (unsigned long) bytes);
+	miscompare_dump(args, ebuf, args->htrsiz*BLK_SIZE, target.lba, i, EXP, this_thread_id);
+	miscompare_dump(args, rbuf, args->htrsiz*BLK_SIZE, target.lba, i, ACT, this_thread_id);
+	/* perform a reread of the target, if requested */
+	if(args->flags & CLD_FLG_ERR_REREAD) {
+		memset(rbuf, SET_CHAR, target.trsiz*BLK_SIZE);
+#ifdef _DEBUG
+		setStartTime();
+#endif
+		tcnt = ReadAt(fd, rbuf, target.trsiz*BLK_SIZE, (OFF_T) (target.lba*BLK_SIZE));
+#ifdef _DEBUG
+		setEndTime();
+		PDBG5(DBUG, args, "Thread %d: ReRead I/O Time: %lu usecs\n", this_thread_id, getTimeDiff());
+#endif
+		if(tcnt != (long) target.trsiz*BLK_SIZE) {
+			pMsg(ERR, args, "Thread %d: ReRead after data miscompare failed on transfer.\n", this_thread_id);
+			pMsg(ERR, args, AFSTR, this_thread_id, "ReRead", (target.oper) ? (env->rcount) : (env->wcount),target.lba,target.lba,tcnt,target.trsiz*BLK_SIZE,GETLASTERROR());
+		}
+		miscompare_dump(args, rbuf, args->htrsiz*BLK_SIZE, target.lba, i, REREAD, this_thread_id);
+	}
+	UNLOCK(MutexMISCOMP);
 
-	/*  set up delay mask of all 1's with value between delayTimeMin and 2*delayTimeMax */
-	while(delayMask <= (args->delayTimeMax - args->delayTimeMin)) { delayMask = delayMask<<1; }
-	delayMask -= 1;
+	return FALSE;
+}
+
+/*
+ * builds the gather list for a marked write.  Each LBA is sent
+ * as its header, marked in hdr, followed by the rest of the block
+ * straight from the data buffer, so the payload is never copied.
+ * Only the bytes the marks cover are put in the header.
+ * Returns the number of segments in iov.
+ */
+int build_write_vec(io_vec_t *iov, unsigned char *hdr, const action_t target, const child_args_t *args, const test_env_t *env)
+{
+	OFF_T lba = target.lba;
+	unsigned char *data = env->data_buffer;
+	size_t hdr_len = mark_length(args);
+	unsigned long i;
+
+	for(i=0;i<target.trsiz;i++) {
+		memcpy(hdr, data, hdr_len);
+		mark_buffer(hdr, hdr_len, &lba, args, env);
+		iov[2*i].iov_base = hdr;
+		iov[2*i].iov_len = hdr_len;
+		iov[(2*i)+1].iov_base = data + hdr_len;
+		iov[(2*i)+1].iov_len = BLK_SIZE - hdr_len;
+		hdr += MARK_HDR_SIZE;
+		data += BLK_SIZE;
+		lba++;
+	}
+	return (int) (2*target.trsiz);
+}
+
+/*
+ * counts a transfer that is about to be retried, or
+ * one that failed for good, in the thread's stats
+ */
+static void count_error(child_ctx_t *ctx, const op_t oper, const BOOL retry)
+{
+	if(retry) {
+		ctx->stats->retries++;
+	} else if(oper == READER) {
+		ctx->stats->rerrors++;
+	} else {
+		ctx->stats->werrors++;
+	}
+}
+
+/*
+ * The synchronous IO loop, one positional transfer at a
+ * time.  Returns the exit code for the thread.
+ */
+int sync_io_loop(child_args_t *args, test_env_t *env, child_ctx_t *ctx, fd_t fd, unsigned char *buf1, unsigned char *buf2, const int this_thread_id, const lvl_t msg_level)
+{
+	unsigned long ulLastError;
+
+	action_t target = { NONE, 0, 0 };
+	OFF_T TargetBytePos=0;
+	long tcnt=0;
+	int exit_code=0, rv=0;
+
+	unsigned int retries = 0;
+	BOOL is_retry = FALSE;
+	OFF_T ioStart, latency = 0, intended = 0;
+#ifdef _DEBUG
+	unsigned long time_diff = 0;
+	OFF_T startTime;
+	OFF_T endTime;
+#endif
+
+	io_vec_t *iov = NULL;
+	unsigned char *hdr = NULL;
+	unsigned char *wbuf = buf2;
+	int iovcnt = 0;
+	BOOL vectored = FALSE;
+
+	extern unsigned long  glb_flags;
+	extern unsigned short glb_run;
+	extern int signal_action;
+
+	target.oper = TST_OPER(args->test_state);
+
+	/* header space and gather list for marked writes, -Iv */
+	if((args->flags & CLD_FLG_VECTOR) && (args->flags & CLD_FLG_MBLK) && !(args->flags & (CLD_FLG_LPTYPE|CLD_FLG_RPTYPE|CLD_FLG_MRK_CRC))) {
+		if(((iov = (io_vec_t *) ALLOC(2*args->htrsiz*sizeof(io_vec_t))) == NULL) ||
+		   ((hdr = (unsigned char *) ALLOC(args->htrsiz*MARK_HDR_SIZE)) == NULL)) {
+			pMsg(ERR, args, "Thread %d: Memory allocation failure for vectored IO, errno = %u\n", this_thread_id, GETLASTERROR());
+			if(iov) FREE(iov);
+			args->test_state = SET_STS_FAIL(args->test_state);
+			glb_flags |= GLB_FLG_FAILED;
+			return(GETLASTERROR());
+		}
+		vectored = TRUE;
+	}
 
-	LOCK(env->mutexs.MutexACTION);
-	set_global_start_time(args, env);
-	UNLOCK(env->mutexs.MutexACTION);
-	
 	while(env->bContinue) {
 		if(!is_retry) {
 			retries = args->retries;
@@ -743,41 +1174,24 @@ void *ChildMain(void *vtest)
 				if(signal_action & SIGNAL_STOP) { break; }		/* user request to stop */
 				if(glb_run == 0) { break; }						/* global request to stop */
 #ifdef _DEBUG
-				startTime = gettime();
+				startTime = getMonoTime();
 #endif
-				LOCK(env->mutexs.MutexACTION);
-				target = get_next_action(args, env, mask);
+				target = next_action(args, env, ctx);
 #ifdef _DEBUG
-			endTime = gettime();
-			time_diff = get_time_diff(&endTime, &startTime);
-			PDBG4(DBUG, args, "Thread %d: get_next_action time: %ld usecs\n", this_thread_id, time_diff);
+			endTime = getMonoTime();
+			time_diff = (unsigned long) ((endTime - startTime) / 1000);
+			PDBG4(DBUG, args, "Thread %d: get_next_action time: %lu usecs\n", this_thread_id, time_diff);
 #endif
-				UNLOCK(env->mutexs.MutexACTION);
-				/* this thread has to retry, so give up the reset of my time slice */
-				if(target.oper == RETRY) { Sleep(0); }
+				/* this thread has to retry, so wait for another thread to release an action */
+				if(target.oper == RETRY) { wait_for_release(env, ctx); }
 			} while((env->bContinue) && (target.oper == RETRY)); /* we failed to get an action, and were asked to retry */
 
 #ifdef _DEBUG
 			PDBG5(DBUG, args, "Thread %d: nextAction: oper: %d, lba: %lld, trsiz: %ld\n", this_thread_id, target.oper, target.lba, target.trsiz);
 #endif
 
-			/*
-			 * Delay delayTime msecs before continuing, for simulated
-			 * processing time, requested by user
-			 */
-			
-			if(args->delayTimeMin == args->delayTimeMax) { /* static delay time */
-				/* only sleep if delay is greater then zero */
-				if(args->delayTimeMin > 0) { Sleep(args->delayTimeMin); } 
-			} else { /* random delay time between min & max */
-				do {
-					delayTime = (unsigned long)(rand()&delayMask) + args->delayTimeMin;
-				} while(delayTime > args->delayTimeMax);
-#ifdef _DEBUG
-				PDBG3(DBUG, args, "Thread %d: Delay time = %lu\n", this_thread_id, delayTime);
-#endif
-				Sleep(delayTime);
-			}
+			io_delay(args, ctx, this_thread_id);
+			if(args->flags & (CLD_FLG_RATE|CLD_FLG_OPEN)) { sleepUntil(io_schedule(args, env, ctx, target, &intended)); }
 		}
 
 #ifdef _DEBUG
@@ -792,70 +1206,33 @@ void *ChildMain(void *vtest)
 		if(glb_run == 0) { break; }						/* global request to stop */
 
 		TargetBytePos=(OFF_T) (target.lba*BLK_SIZE);
-		ActualBytePos=Seek(fd, TargetBytePos);
-		if(ActualBytePos != TargetBytePos) {
-			ulLastError = GETLASTERROR();
-			pMsg(msg_level, args, SFSTR, this_thread_id, (target.oper == WRITER) ? (env->wcount) : (env->rcount),target.lba,TargetBytePos,ActualBytePos,ulLastError);
-			if(retries-- > 1) { /* request to retry on error, decrement retry */
-				pMsg(INFO, args, "Thread %d: Retry after seek failure, retry count: %u\n", this_thread_id, retries);
-				is_retry = TRUE;
-				Sleep(args->retry_delay);
-			} else {
-				exit_code = SEEK_FAILURE;
-				is_retry = FALSE;
-				LOCK(env->mutexs.MutexACTION);
-				update_test_state(args, env, this_thread_id, fd, buf2);
-				decrement_io_count(args, env, target);
-				UNLOCK(env->mutexs.MutexACTION);
-			}
-			continue;
-		}
 
 		if(target.oper == WRITER) {
-			if(args->flags & CLD_FLG_LPTYPE) {
-				fill_buffer(buf2, target.trsiz, &(target.lba), sizeof(OFF_T), CLD_FLG_LPTYPE);
+			if(vectored) {
+				iovcnt = build_write_vec(iov, hdr, target, args, env);
 			} else {
-				memcpy(buf2, env->data_buffer, target.trsiz*BLK_SIZE);
+				wbuf = write_data(buf2, target, args, env);
 			}
-			if(args->flags & CLD_FLG_MBLK) {
-				mark_buffer(buf2, target.trsiz*BLK_SIZE, &(target.lba), args, env);
-			}
-			startTime = gettime();
-#ifdef _DEBUG
-#endif
+			ctx->stats->inflight = 1;
+			ioStart = (intended != 0) ? intended : getMonoTime();
 			if(args->flags & CLD_FLG_IO_SERIAL) {
 				LOCK(env->mutexs.MutexIO);
-				tcnt = Write(fd, buf2, target.trsiz*BLK_SIZE);
+				tcnt = (vectored) ? WriteVAt(fd, iov, iovcnt, TargetBytePos) : WriteAt(fd, wbuf, target.trsiz*BLK_SIZE, TargetBytePos);
 				UNLOCK(env->mutexs.MutexIO);
 			} else {
-				tcnt = Write(fd, buf2, target.trsiz*BLK_SIZE);
+				tcnt = (vectored) ? WriteVAt(fd, iov, iovcnt, TargetBytePos) : WriteAt(fd, wbuf, target.trsiz*BLK_SIZE, TargetBytePos);
 			}
-
-			endTime = gettime();
-			time_diff = get_time_diff(&endTime, &startTime);
+			latency = getMonoTime() - ioStart;
+			ctx->stats->inflight = 0;
 #ifdef _DEBUG
-			PDBG5(DBUG, args, "Thread %d: I/O Time: %ld usecs\n", this_thread_id, time_diff);
+			PDBG5(DBUG, args, "Thread %d: I/O Time: %lld usecs\n", this_thread_id, latency/1000);
 #endif
 			if(args->flags & CLD_FLG_WFSYNC) {
-				rv = 0;
-				/* if need to sync, then only have one thread do it, force others to wait */
-				LOCK(env->mutexs.MutexACTION);
-				if(0 == (env->hbeat_stats.wcount % args->sync_interval)) {
-#ifdef _DEBUG
-					PDBG3(DBUG, args, "Thread %d: Performing sync, write IO count %llu\n", this_thread_id, env->hbeat_stats.wcount);
-#endif
-					rv = Sync(fd);
-					if(0 != rv) {
-						exit_code = GETLASTERROR();
-						pMsg(msg_level, args, "Thread %d: fsync error = %d\n", this_thread_id, exit_code);
-						is_retry = FALSE;
-						update_test_state(args, env, this_thread_id, fd, buf2);
-						decrement_io_count(args, env, target);
-					}
-				}
-				UNLOCK(env->mutexs.MutexACTION);
-
-				if(0 != rv) { /* sync error, so don't count the write */
+				if(0 != (rv = sync_write(args, env, fd, target, buf2, this_thread_id, msg_level))) {
+					/* sync error, so don't count the write */
+					count_error(ctx, WRITER, FALSE);
+					exit_code = rv;
+					is_retry = FALSE;
 					continue;
 				}
 			}
@@ -863,20 +1240,19 @@ void *ChildMain(void *vtest)
 
 		if(target.oper == READER) {
 			//memset(buf1, SET_CHAR, target.trsiz*BLK_SIZE);
-#ifdef _DEBUG
-			startTime = gettime();
-#endif
+			ctx->stats->inflight = 1;
+			ioStart = (intended != 0) ? intended : getMonoTime();
 			if(args->flags & CLD_FLG_IO_SERIAL) {
 				LOCK(env->mutexs.MutexIO);
-				tcnt = Read(fd, buf1, target.trsiz*BLK_SIZE);
+				tcnt = ReadAt(fd, buf1, target.trsiz*BLK_SIZE, TargetBytePos);
 				UNLOCK(env->mutexs.MutexIO);
 			} else {
-				tcnt = Read(fd, buf1, target.trsiz*BLK_SIZE);
+				tcnt = ReadAt(fd, buf1, target.trsiz*BLK_SIZE, TargetBytePos);
 			}
+			latency = getMonoTime() - ioStart;
+			ctx->stats->inflight = 0;
 #ifdef _DEBUG
-			endTime = gettime();
-			time_diff = get_time_diff(&endTime, &startTime);
-			PDBG5(DBUG, args, "Thread %d: I/O Time: %ld usecs\n", this_thread_id, time_diff);
+			PDBG5(DBUG, args, "Thread %d: I/O Time: %lld usecs\n", this_thread_id, latency/1000);
 #endif
 		}
 
@@ -885,9 +1261,11 @@ void *ChildMain(void *vtest)
 			pMsg(msg_level, args, AFSTR, this_thread_id, (target.oper) ? "Read" : "Write", (target.oper) ? (env->rcount) : (env->wcount),target.lba,target.lba,tcnt,target.trsiz*BLK_SIZE, ulLastError);
 			if(retries-- > 1) { /* request to retry on error, decrement retry */
 				pMsg(INFO, args, "Thread %d: Retry after transfer failure, retry count: %u\n", this_thread_id, retries);
+				count_error(ctx, target.oper, TRUE);
 				is_retry = TRUE;
 				Sleep(args->retry_delay);
 			} else {
+				count_error(ctx, target.oper, FALSE);
 				exit_code = ACCESS_FAILURE;
 				is_retry = FALSE;
 				LOCK(env->mutexs.MutexACTION);
@@ -898,58 +1276,9 @@ void *ChildMain(void *vtest)
 			continue;
 		}
 
-
-		/* data compare routine.  Act as if we were to write, but just compare */
 		if((target.oper == READER) && (args->flags & CLD_FLG_CMPR)) {
-			/* This is very SLOW!!! */
-			if((args->cmp_lng == 0) || (args->cmp_lng > target.trsiz*BLK_SIZE)) {
-				args->cmp_lng = target.trsiz*BLK_SIZE;
-			}
-			if(args->flags & CLD_FLG_LPTYPE) {
-				fill_buffer(buf2, target.trsiz, &(target.lba), sizeof(OFF_T), CLD_FLG_LPTYPE);
-			} else {
-				memcpy(buf2, env->data_buffer, target.trsiz*BLK_SIZE);
-			}
-			if(args->flags & CLD_FLG_MBLK) {
-				mark_buffer(buf2, target.trsiz*BLK_SIZE, &(target.lba), args, env);
-			}
-			if(memcmp(buf2, buf1, args->cmp_lng) != 0) {
-				/* data miscompare, this takes lots of time, but its OK... !!! */
-				LOCK(MutexMISCOMP);
-    			pMsg(ERR, args, DMSTR, this_thread_id, target.lba, target.lba);
-				/* find the actual byte that started the miscompare */
-				for(i=0;i<args->htrsiz*BLK_SIZE;i++) {
-					if(*(buf2+i) != *(buf1+i)) {
-    					pMsg(ERR, args, DMOFFSTR, this_thread_id, i, i); break;
-					}
-				}
-				miscompare_dump(args, buf2, args->htrsiz*BLK_SIZE, target.lba, i, EXP, this_thread_id);
-				miscompare_dump(args, buf1, args->htrsiz*BLK_SIZE, target.lba, i, ACT, this_thread_id);
-				/* perform a reread of the target, if requested */
-				if(args->flags & CLD_FLG_ERR_REREAD) {
-					ActualBytePos=Seek(fd, TargetBytePos);
-					if(ActualBytePos == TargetBytePos) {
-						memset(buf1, SET_CHAR, target.trsiz*BLK_SIZE);
-#ifdef _DEBUG
-						setStartTime();
-#endif
-						tcnt = Read(fd, buf1, target.trsiz*BLK_SIZE);
-#ifdef _DEBUG
-						setEndTime();
-						PDBG5(DBUG, args, "Thread %d: ReRead I/O Time: %ld usecs\n", this_thread_id, getTimeDiff());
-#endif
-						if(tcnt != (long) target.trsiz*BLK_SIZE) {
-							pMsg(ERR, args, "Thread %d: ReRead after data miscompare failed on transfer.\n", this_thread_id);
-							pMsg(ERR, args, AFSTR, this_thread_id, "ReRead", (target.oper) ? (env->rcount) : (env->wcount),target.lba,target.lba,tcnt,target.trsiz*BLK_SIZE);
-						}
-						miscompare_dump(args, buf1, args->htrsiz*BLK_SIZE, target.lba, i, REREAD, this_thread_id);
-					} else {
-						pMsg(ERR, args, "Thread %d: ReRead after data miscompare failed on seek.\n", this_thread_id);
-						pMsg(ERR, args, SFSTR, this_thread_id, (target.oper == WRITER) ? (env->wcount) : (env->rcount),target.lba,TargetBytePos,ActualBytePos);
-					}
-				}
-				UNLOCK(MutexMISCOMP);
-
+			if(!verify_data(args, env, fd, target, buf1, buf2, this_thread_id)) {
+				count_error(ctx, READER, FALSE);
 				exit_code = DATA_MISCOMPARE;
 				is_retry = FALSE;
 				LOCK(env->mutexs.MutexACTION);
@@ -962,56 +1291,471 @@ void *ChildMain(void *vtest)
 
 		/* update stats, bitmap, and release LBA */
 #ifdef _DEBUG
-            startTime = gettime();
+            startTime = getMonoTime();
 #endif
-			complete_io(env, args, target, time_diff);
+			complete_io(env, args, ctx, target, latency);
 #ifdef _DEBUG
-            endTime = gettime();
-            time_diff = get_time_diff(&endTime, &startTime);
-            PDBG4(DBUG, args, "Thread %d: complete_io time: %ld usecs\n", this_thread_id, time_diff);
+            endTime = getMonoTime();
+            time_diff = (unsigned long) ((endTime - startTime) / 1000);
+            PDBG4(DBUG, args, "Thread %d: complete_io time: %lu usecs\n", this_thread_id, time_diff);
 #endif
 
 		is_retry = FALSE;
 	}
-	LOCK(env->mutexs.MutexACTION);
-	set_global_stop_time(args, env);
-	UNLOCK(env->mutexs.MutexACTION);
+
+	if(iov) FREE(iov);
+	if(hdr) FREE(hdr);
+
+	return exit_code;
+}
+
+/*
+ * IO buffers come from the target's arena with -I h, or the heap, with
+ * room to align them, otherwise, or when the arena has run out.
+ */
+unsigned char *alloc_io_buffer(test_env_t *env, const size_t size)
+{
+	unsigned char *buffer;
+
+	if(env->arena != NULL) {
+		if((buffer = (unsigned char *) ArenaAlloc(env->arena, size)) != NULL) {
+			return buffer;
+		}
+	}
+	return (unsigned char *) ALLOC(size+ALIGNSIZE);
+}
+
+void free_io_buffer(test_env_t *env, unsigned char *buffer)
+{
+	/* arena buffers are released with the arena */
+	if((env->arena == NULL) || !ArenaOwns(env->arena, buffer)) FREE(buffer);
+}
+
+void free_io_slots(test_env_t *env, io_slot_t *slots, const unsigned int depth)
+{
+	unsigned int i;
+
+	if(slots == NULL) return;
+	for(i=0;i<depth;i++) {
+		if(slots[i].buffer) free_io_buffer(env, slots[i].buffer);
+	}
+	FREE(slots);
+}
+
+/*
+ * The async IO loop, used with -I u.  Keeps up to io_depth transfers
+ * in flight on fd.  Actions are still handed out by get_next_action and
+ * retired by complete_io, so LBA locking, the write bitmap and stats
+ * work the same as they do for the synchronous loop.  Returns the exit
+ * code for the thread.
+ */
+int async_io_loop(child_args_t *args, test_env_t *env, child_ctx_t *ctx, fd_t fd, unsigned char *err_buf, const int this_thread_id, const lvl_t msg_level)
+{
+	unsigned long ulLastError;
+	size_t buf_siz = args->htrsiz*BLK_SIZE;
+	unsigned int depth = args->io_depth;
+
+	async_ctx_t *actx = NULL;
+	async_event_t *events = NULL;
+	io_slot_t *slots = NULL, *slot, *held = NULL;
+	unsigned int *free_slots = NULL, *retry_slots = NULL;
+	unsigned int nfree = 0, nretry = 0, inflight = 0, queued = 0, i;
+	int exit_code=0, rv=0, nevents, e;
+	BOOL draining = FALSE;
+	action_t target = { NONE, 0, 0 };
+	OFF_T endTime, now, wake;
+
+	extern unsigned long  glb_flags;
+	extern unsigned short glb_run;
+	extern int signal_action;
+
+	if((slots = (io_slot_t *) ALLOC(depth*sizeof(io_slot_t))) != NULL) {
+		memset(slots, 0, depth*sizeof(io_slot_t));
+		for(i=0;i<depth;i++) {
+			if((slots[i].buffer = alloc_io_buffer(env, buf_siz)) == NULL) break;
+			slots[i].buf = (unsigned char *) BUFALIGN(slots[i].buffer);
+			memset(slots[i].buf, 0, buf_siz);
+		}
+	}
+	free_slots = (unsigned int *) ALLOC(depth*sizeof(unsigned int));
+	retry_slots = (unsigned int *) ALLOC(depth*sizeof(unsigned int));
+	events = (async_event_t *) ALLOC(depth*sizeof(async_event_t));
+	if((slots == NULL) || (i < depth) || (free_slots == NULL) || (retry_slots == NULL) || (events == NULL)) {
+		pMsg(ERR, args, "Thread %d: Memory allocation failure for async IO buffers, errno = %u\n", this_thread_id, GETLASTERROR());
+		free_io_slots(env, slots, depth);
+		if(free_slots) FREE(free_slots);
+		if(retry_slots) FREE(retry_slots);
+		if(events) FREE(events);
+		args->test_state = SET_STS_FAIL(args->test_state);
+		glb_flags |= GLB_FLG_FAILED;
+		return(GETLASTERROR());
+	}
+	for(i=0;i<depth;i++) { free_slots[nfree++] = depth-i-1; }
+
+	if((actx = AsyncOpen(fd, depth, args->flags)) == NULL) {
+		pMsg(ERR, args, "Thread %d: could not create async IO context for %s, errno = %u\n", this_thread_id, args->device, GETLASTERROR());
+		free_io_slots(env, slots, depth);
+		FREE(free_slots);
+		FREE(retry_slots);
+		FREE(events);
+		args->test_state = SET_STS_FAIL(args->test_state);
+		glb_flags |= GLB_FLG_FAILED;
+		return(GETLASTERROR());
+	}
+
+	for(;;) {
+		if(signal_action & SIGNAL_STOP) { draining = TRUE; }	/* user request to stop */
+		if(env->bContinue == FALSE) { draining = TRUE; }		/* internal request to stop */
+		if(glb_run == 0) { draining = TRUE; }					/* global request to stop */
+
+		/* resend the failed transfers that have waited out the retry delay */
+		now = getMonoTime();
+		for(i=0;i<nretry;) {
+			slot = &slots[retry_slots[i]];
+			if(slot->due > now) { i++; continue; }
+			if(slot->intended == 0) { slot->startTime = now; }
+			AsyncQueue(actx, retry_slots[i], slot->target.oper, slot->data, slot->target.trsiz*BLK_SIZE, slot->target.lba*BLK_SIZE);
+			retry_slots[i] = retry_slots[--nretry];
+			inflight++;
+			queued++;
+		}
+
+		/* keep the queue full, holding back an action the -l caps say is not yet due */
+		while((held != NULL) || (!draining && (nfree > 0))) {
+			if(held == NULL) {
+				target = next_action(args, env, ctx);
+				if(target.oper == NONE) {						/* nothing left, finish what is in flight */
+					draining = TRUE;
+					break;
+				}
+				if(target.oper == RETRY) {
+					/* nothing to reap, so wait for another thread to release an action */
+					if(inflight == 0) { wait_for_release(env, ctx); }
+					break;
+				}
+
+				io_delay(args, ctx, this_thread_id);
+
+				held = &slots[free_slots[--nfree]];
+				held->target = target;
+				held->due = io_schedule(args, env, ctx, target, &held->intended);
+			}
+			if(!draining && (held->due > getMonoTime())) break;
+
+			slot = held;
+			held = NULL;
+			target = slot->target;
+			slot->retries = args->retries;
+			slot->data = (target.oper == WRITER) ? write_data(slot->buf, target, args, env) : slot->buf;
+			slot->startTime = (slot->intended != 0) ? slot->intended : getMonoTime();
+			AsyncQueue(actx, (unsigned int) (slot - slots), target.oper, slot->data, target.trsiz*BLK_SIZE, target.lba*BLK_SIZE);
+			inflight++;
+			queued++;
+		}
+		ctx->stats->inflight = inflight;
+
+		if(queued > 0) {
+			if((rv = AsyncSubmit(actx)) < 0) {
+				pMsg(msg_level, args, "Thread %d: async IO submit failed, errno = %u\n", this_thread_id, GETLASTERROR());
+				queued = 0;
+			} else {
+				queued = (unsigned int) rv;		/* pushed back, sent again after reaping */
+			}
+			if((queued > 0) && (inflight == queued)) {
+				/* nothing the kernel has to complete, so wait a little before trying again */
+				sleepUntil(getMonoTime() + ASYNC_BACKOFF);
+				continue;
+			}
+		}
+
+		/* wake for the held action or the first retry, whichever is due first */
+		wake = (held != NULL) ? held->due : 0;
+		for(i=0;i<nretry;i++) {
+			if((wake == 0) || (slots[retry_slots[i]].due < wake)) { wake = slots[retry_slots[i]].due; }
+		}
+
+		if(inflight == 0) {
+			if(wake != 0) { sleepUntil(wake); }
+			else if(draining) break;
+			continue;
+		}
+
+		if(wake != 0) {
+			nevents = AsyncWait(actx, events, depth, wake);
+		} else {
+			nevents = AsyncReap(actx, events, 1, depth);
+		}
+		if(nevents < 0) {
+			pMsg(ERR, args, "Thread %d: async IO reap failed, errno = %u\n", this_thread_id, GETLASTERROR());
+			/* the transfers in flight can't be accounted for, so stop IO to this target */
+			exit_code = ACCESS_FAILURE;
+			args->test_state = SET_STS_FAIL(args->test_state);
+			glb_flags |= GLB_FLG_FAILED;
+			env->bContinue = FALSE;
+			break;
+		}
+		endTime = getMonoTime();
+
+		for(e=0;e<nevents;e++) {
+			slot = &slots[events[e].slot];
+			target = slot->target;
+
+			if(events[e].result != (long) target.trsiz*BLK_SIZE) {
+				ulLastError = (events[e].result < 0) ? (unsigned long) -events[e].result : 0;
+				pMsg(msg_level, args, AFSTR, this_thread_id, (target.oper) ? "Read" : "Write", (target.oper) ? (env->rcount) : (env->wcount),target.lba,target.lba,events[e].result,target.trsiz*BLK_SIZE, ulLastError);
+				if(slot->retries-- > 1) { /* request to retry on error, decrement retry */
+					pMsg(INFO, args, "Thread %d: Retry after transfer failure, retry count: %u\n", this_thread_id, slot->retries);
+					count_error(ctx, target.oper, TRUE);
+					/* hold the slot for the retry delay, rather than stall the others in flight */
+					slot->due = getMonoTime() + (OFF_T) args->retry_delay * 1000000;
+					retry_slots[nretry++] = events[e].slot;
+					inflight--;
+					continue;
+				}
+				count_error(ctx, target.oper, FALSE);
+				exit_code = ACCESS_FAILURE;
+				LOCK(env->mutexs.MutexACTION);
+				update_test_state(args, env, this_thread_id, fd, err_buf);
+				decrement_io_count(args, env, target);
+				UNLOCK(env->mutexs.MutexACTION);
+			} else if((target.oper == WRITER) && (args->flags & CLD_FLG_WFSYNC) &&
+					  (0 != (rv = sync_write(args, env, fd, target, err_buf, this_thread_id, msg_level)))) {
+				/* sync error, so don't count the write */
+				count_error(ctx, WRITER, FALSE);
+				exit_code = rv;
+			} else if((target.oper == READER) && (args->flags & CLD_FLG_CMPR) &&
+					  !verify_data(args, env, fd, target, slot->buf, err_buf, this_thread_id)) {
+				count_error(ctx, READER, FALSE);
+				exit_code = DATA_MISCOMPARE;
+				LOCK(env->mutexs.MutexACTION);
+				update_test_state(args, env, this_thread_id, fd, err_buf);
+				decrement_io_count(args, env, target);
+				UNLOCK(env->mutexs.MutexACTION);
+			} else {
+				/* update stats, bitmap, and release LBA */
+				complete_io(env, args, ctx, target, endTime - slot->startTime);
+			}
+			free_slots[nfree++] = events[e].slot;
+			inflight--;
+		}
+		ctx->stats->inflight = inflight;
+	}
+
+	AsyncClose(actx);
+	free_io_slots(env, slots, depth);
+	FREE(free_slots);
+	FREE(retry_slots);
+	FREE(events);
+
+	return exit_code;
+}
+
+/*
+* This function is really the main function for a thread
+* Once here, this function will act as if it
+* were 'main' for that thread.
+*/
+/*
+ * called by a pool child to wait for the main thread to start a pass
+ * after gen, the last one it ran, which gen is set to.  Each pass is
+ * run once by every child.  Returns FALSE when the pool is to exit.
+ */
+BOOL wait_for_pass(test_env_t *env, unsigned int *gen)
+{
+	BOOL run;
+
+	LOCK(env->mutexs.MutexPOOL);
+	while(env->pass_gen == *gen) {
+		COND_WAIT(env->mutexs.CondPOOL, env->mutexs.MutexPOOL, POOL_WAIT_MSEC);
+	}
+#ifdef WINDOWS
+	/* CondPOOL only wakes one waiter, so pass it on */
+	COND_BROADCAST(env->mutexs.CondPOOL);
+#endif
+	*gen = env->pass_gen;
+	run = !env->bPoolExit;
+	UNLOCK(env->mutexs.MutexPOOL);
+	return run;
+}
+
+/*
+ * called by a pool child when it has finished pass gen,
+ * the last one to finish tells the main thread
+ */
+void child_done(test_env_t *env, const unsigned int gen)
+{
+	BOOL last = FALSE;
+
+	LOCK(env->mutexs.MutexPOOL);
+	if((gen == env->pass_gen) && (env->active > 0)) {
+		last = (--env->active == 0);
+	}
+	UNLOCK(env->mutexs.MutexPOOL);
+	if(last) { SEM_POST(env->mutexs.SemDONE, 1); }
+}
+
+/*
+ * a pool child that could not get set up still has to take part
+ * in every pass, so the main thread is not left waiting, until
+ * the pool exits
+ */
+void child_abort(test_env_t *env)
+{
+	unsigned int gen = 0;
+
+	while(wait_for_pass(env, &gen)) { child_done(env, gen); }
+}
+
+#ifdef WINDOWS
+DWORD WINAPI ChildMain(test_ll_t *test)
+#else
+void *ChildMain(void *vtest)
+#endif
+{
+#ifndef WINDOWS
+	test_ll_t *test = (test_ll_t *)vtest;
+#endif
+
+	child_args_t *args = test->args;
+	test_env_t *env = test->env;
+
+	static int thread_id = 0;
+	int this_thread_id = thread_id++;
+	child_ctx_t ctx;
+	unsigned char *buf1 = NULL, *buffer1 = NULL; /* 'buf' is the aligned 'buffer' */
+	unsigned char *buf2 = NULL, *buffer2 = NULL; /* 'buf' is the aligned 'buffer' */
+
+	int exit_code=0;
+	unsigned int gen = 0;
+	char filespec[DEV_NAME_LEN];
+	fd_t fd;
+
+	lvl_t msg_level = WARN;
+	int SET_CHAR = 0; /* when data buffers are cleared, using memset, use this */
+
+	extern unsigned long  glb_flags;
+
+#ifdef WINDOWS
+	if((MutexMISCOMP = OpenMutex(SYNCHRONIZE, TRUE, "gbl")) == NULL) {
+		pMsg(ERR, args, "Thread %d: Failed to open semaphore, error = %u\n", this_thread_id, GetLastError());
+		args->test_state = SET_STS_FAIL(args->test_state);
+		glb_flags |= GLB_FLG_FAILED;
+		child_abort(env);
+		TEXIT(GETLASTERROR());
+	}
+#endif
+
+	/*
+	 * For some messages, the error level will change, based on if
+	 * the test should continue on error, or stop on error.
+	 */
+	if((args->flags & CLD_FLG_ALLDIE) || (glb_flags & GLB_FLG_KILL)) {
+		msg_level = ERR;
+	}
+
+	strncpy(filespec, args->device, DEV_NAME_LEN);
+
+	fd = Open(filespec, args->flags);
+	if(INVALID_FD(fd)) {
+		pMsg(ERR, args, "Thread %d: could not open %s, errno = %u.\n", this_thread_id,args->device, GETLASTERROR());
+		args->test_state = SET_STS_FAIL(args->test_state);
+		glb_flags |= GLB_FLG_FAILED;
+		child_abort(env);
+		TEXIT(GETLASTERROR());
+	}
+
+	/* Create aligned memory buffers for sending IO. */
+	if ((buffer1 = alloc_io_buffer(env, args->htrsiz*BLK_SIZE)) == NULL) {
+		pMsg(ERR, args, "Thread %d: Memory allocation failure for IO buffer, errno = %u\n", this_thread_id, GETLASTERROR());
+		args->test_state = SET_STS_FAIL(args->test_state);
+		glb_flags |= GLB_FLG_FAILED;
+		CLOSE(fd);
+		child_abort(env);
+		TEXIT(GETLASTERROR());
+	}
+	buf1 = (unsigned char *) BUFALIGN(buffer1);
+	memset(buf1, SET_CHAR, args->htrsiz*BLK_SIZE);
+
+	if ((buffer2 = alloc_io_buffer(env, args->htrsiz*BLK_SIZE)) == NULL) {
+		pMsg(ERR, args, "Thread %d: Memory allocation failure for IO buffer, errno = %u\n", this_thread_id, GETLASTERROR());
+		free_io_buffer(env, buffer1);
+		args->test_state = SET_STS_FAIL(args->test_state);
+		glb_flags |= GLB_FLG_FAILED;
+		CLOSE(fd);
+		child_abort(env);
+		TEXIT(GETLASTERROR());
+	}
+	buf2 = (unsigned char *) BUFALIGN(buffer2);
+	memset(buf2, SET_CHAR, args->htrsiz*BLK_SIZE);
+
+	memset(&ctx, 0, sizeof(child_ctx_t));
+	ctx.index = (unsigned int) ATOMIC_ADD(&(env->child_count), 1) % args->t_kids;
+	ctx.stats = &env->thread_stats[ctx.index];
+	ctx.lat = &env->thread_lat[2*ctx.index];
+
+	/* run a pass each time the main thread starts the pool */
+	while(wait_for_pass(env, &gen)) {
+
+		/*
+		 * each thread gets its own random number generator, seeded from
+		 * the test seed, pass, and its index within the target, so runs
+		 * can be repeated
+		 */
+		RandSeed(&ctx.rand_state, (unsigned long long) args->seed, ((unsigned long long) env->pass_count << 16) | ctx.index);
+		ctx.pending.oper = NONE;
+
+		LOCK(env->mutexs.MutexACTION);
+		set_global_start_time(args, env);
+		UNLOCK(env->mutexs.MutexACTION);
+
+		if(args->flags & CLD_FLG_ASYNC) {
+			exit_code = async_io_loop(args, env, &ctx, fd, buf2, this_thread_id, msg_level);
+		} else {
+			exit_code = sync_io_loop(args, env, &ctx, fd, buf1, buf2, this_thread_id, msg_level);
+		}
+
+		LOCK(env->mutexs.MutexACTION);
+		set_global_stop_time(args, env);
+		UNLOCK(env->mutexs.MutexACTION);
 
 #ifdef _DEBUG
 #ifdef _DEBUG_PRINTMAP
-	LOCK(env->mutexs.MutexACTION);
-	print_lba_bitmap(env);
-	UNLOCK(env->mutexs.MutexACTION);
+		LOCK(env->mutexs.MutexACTION);
+		print_lba_bitmap(env);
+		UNLOCK(env->mutexs.MutexACTION);
 #endif
 #endif
 
-	FREE(buffer1);
-	FREE(buffer2);
-
 #ifdef LINUX
-	if((args->flags & CLD_FLG_W) && !(args->flags & CLD_FLG_RAW)) {
+		if((args->flags & CLD_FLG_W) && !(args->flags & CLD_FLG_RAW)) {
 #else
-	/*
-	 * Windows/AIX throws ERROR: ERROR_INVALID_FUNCTION
-	 * if we attempt to sync on anything but a file
-	 */
-	if((args->flags & CLD_FLG_FILE) && (args->flags & CLD_FLG_W)) {
+		/*
+		 * Windows/AIX throws ERROR: ERROR_INVALID_FUNCTION
+		 * if we attempt to sync on anything but a file
+		 */
+		if((args->flags & CLD_FLG_FILE) && (args->flags & CLD_FLG_W)) {
 #endif
 
 #ifdef _DEBUG
-		PDBG3(DBUG, args, "Thread %d: starting sync\n", this_thread_id);
+			PDBG3(DBUG, args, "Thread %d: starting sync\n", this_thread_id);
 #endif
-	    if (Sync(fd) < 0) { /* just sync, should not matter the device type */
-			exit_code = GETLASTERROR();
-			pMsg(ERR, args, "Thread %d: fsync error = %d\n", this_thread_id, exit_code);
-			args->test_state = SET_STS_FAIL(args->test_state);
-			glb_flags |= GLB_FLG_FAILED;
-		}
+			if (Sync(fd) < 0) { /* just sync, should not matter the device type */
+				exit_code = GETLASTERROR();
+				pMsg(ERR, args, "Thread %d: fsync error = %d\n", this_thread_id, exit_code);
+				args->test_state = SET_STS_FAIL(args->test_state);
+				glb_flags |= GLB_FLG_FAILED;
+			}
 #ifdef _DEBUG
-		PDBG3(DBUG, args, "Thread %d: finished sync\n", this_thread_id);
+			PDBG3(DBUG, args, "Thread %d: finished sync\n", this_thread_id);
 #endif
+		}
+
+		child_done(env, gen);
 	}
 
+	free_io_buffer(env, buffer1);
+	free_io_buffer(env, buffer2);
+
 	if (CLOSE(fd) < 0) { /* check return status on close */
 		exit_code = GETLASTERROR();
 		pMsg(ERR, args, "Thread %d: close error = %d\n", this_thread_id, exit_code);
@@ -33,11 +33,30 @@
 #define ACCESS_FAILURE	2
 #define DATA_MISCOMPARE	3
 
+#define ACTION_WAIT_MSEC	10	/* longest a thread waits on CondACTION before trying again */
+#define POOL_WAIT_MSEC		100	/* longest a pool child waits on CondPOOL before checking again */
+
 typedef enum mc_func {
 	EXP,ACT,REREAD
 } mc_func_t;
 
-#define DMOFFSTR "Thread %d: First miscompare at byte offset %d (0x%X)\n"
+/*
+ * state kept by each test thread
+ */
+typedef struct child_ctx {
+	unsigned int index;			/* index of this thread within its target */
+	rand_state_t rand_state;	/* this thread's random number generator */
+	action_t rnd;				/* random transfer size and lba, picked before taking MutexACTION */
+	action_t pending;			/* dispensed action that could not be started yet */
+	unsigned int release;		/* env->action_release when the last action was picked */
+	thread_stats_t *stats;		/* this thread's IO counts */
+	latency_t *lat;				/* this thread's latency histograms, indexed by oper */
+} child_ctx_t;
+
+#define DMOFFSTR "Thread %d: First miscompare at byte offset %lu (0x%lX)\n"
+#define DMCNTSTR "Thread %d: %lu of %lu blocks miscompared, %lu bytes differ\n"
+
+void clear_action_list(test_env_t *, const child_args_t *);
 
 #ifdef WINDOWS
 #define DMSTR "Thread %d: Data miscompare at lba %I64d (0x%I64X)\n"
@@ -180,15 +180,10 @@ int do_dump(child_args_t *args)
 		return(-1);
 	}
 
-	TargetLBA = Seek(fd, args->start_lba*BLK_SIZE);
-	if(TargetLBA != (args->start_lba * (OFF_T) BLK_SIZE)) {
-		pMsg(ERR, args, "Could not seek to start position.\n");
-		CLOSE(fd);
-		return(-1);
-	}
+	TargetLBA = args->start_lba * (OFF_T) BLK_SIZE;
 
 	do {
-		NumBytes = Read(fd, buff, args->htrsiz*BLK_SIZE);
+		NumBytes = ReadAt(fd, buff, args->htrsiz*BLK_SIZE, TargetLBA+TotalBytes);
 		if((NumBytes > args->htrsiz*BLK_SIZE) || (NumBytes < 0)) {
 			pMsg(ERR, args, "Failure reading %s\n", args->device);
 			pMsg(ERR, args, "Last Error was %lu\n", GETLASTERROR());
@@ -41,11 +41,12 @@
 #include "main.h"
 #include "threading.h"
 #include "sfunc.h"
+#include "timer.h"
 
 /* Globals */
 unsigned int gbl_dbg_lvl;	/* the global debugging level	*/
 unsigned long glb_flags;    /* global flags GLB_FLG_xxx	*/
-time_t global_start_time;	/* global start time */
+OFF_T global_start_time;	/* global start time, nsecs from getMonoTime */
 unsigned short glb_run = 1;	/* global run flag */
 
 void init_gbl_data(test_env_t *env)
@@ -58,9 +59,11 @@ void init_gbl_data(test_env_t *env)
 	env->bContinue = TRUE;
 	env->pass_count = 0;
 	env->start_time = time(NULL);	/*	overall start time of test	*/
+	env->start_mono = getMonoTime();
 	env->end_time = 0;				/*	overall end time of test	*/
 	memset(&env->global_stats, 0, sizeof(stats_t));
 	memset(&env->cycle_stats, 0, sizeof(stats_t));
+	memset(&env->stats_base, 0, sizeof(stats_t));
 }
 
 #ifdef WINDOWS
@@ -36,6 +36,7 @@
 #include <pthread.h>
 #include <fcntl.h>
 #endif
+#include <string.h>
 
 #include "defs.h"
 #include "main.h"
@@ -63,6 +64,73 @@ long Read(fd_t fd, void *buf, const unsigned long trsiz)
 	return(tcnt);
 }
 
+/*
+ * positional transfers, the file pointer is not used, so
+ * no seek is needed before the transfer
+ */
+long WriteAt(fd_t fd, const void *buf, const unsigned long trsiz, const OFF_T pos)
+{
+	long tcnt;
+#ifdef WINDOWS
+	OVERLAPPED ov;
+
+	memset(&ov, 0, sizeof(OVERLAPPED));
+	ov.Offset = (DWORD) (pos & 0xFFFFFFFF);
+	ov.OffsetHigh = (DWORD) (pos >> 32);
+	WriteFile(fd, buf, trsiz, &tcnt, &ov);
+#else
+	tcnt = pwrite(fd, buf, trsiz, pos);
+#endif
+	return(tcnt);
+}
+
+long ReadAt(fd_t fd, void *buf, const unsigned long trsiz, const OFF_T pos)
+{
+	long tcnt;
+#ifdef WINDOWS
+	OVERLAPPED ov;
+
+	memset(&ov, 0, sizeof(OVERLAPPED));
+	ov.Offset = (DWORD) (pos & 0xFFFFFFFF);
+	ov.OffsetHigh = (DWORD) (pos >> 32);
+	ReadFile(fd, buf, trsiz, &tcnt, &ov);
+#else
+	tcnt = pread(fd, buf, trsiz, pos);
+#endif
+	return(tcnt);
+}
+
+/*
+ * positional gather write of iovcnt segments, split into
+ * groups of IOV_MAX segments.  Returns the bytes written,
+ * which is short if any group was short.
+ */
+long WriteVAt(fd_t fd, const io_vec_t *iov, const int iovcnt, const OFF_T pos)
+{
+	long tcnt = 0, rv = 0, len;
+	int i, j, cnt;
+
+	for(i=0;i<iovcnt;i+=cnt) {
+		cnt = ((iovcnt - i) > IOV_MAX) ? IOV_MAX : (iovcnt - i);
+		for(len=0,j=i;j<(i+cnt);j++) { len += (long) iov[j].iov_len; }
+#ifdef LINUX
+		rv = pwritev(fd, iov+i, cnt, pos+tcnt);
+#else
+		/* no gather write, send the segments one at a time */
+		for(rv=0,j=i;j<(i+cnt);j++) {
+			long seg = WriteAt(fd, iov[j].iov_base, iov[j].iov_len, pos+tcnt+rv);
+			if(seg < 0) { rv = (rv > 0) ? rv : seg; break; }
+			rv += seg;
+			if(seg != (long) iov[j].iov_len) break;
+		}
+#endif
+		if(rv < 0) return((tcnt > 0) ? tcnt : rv);
+		tcnt += rv;
+		if(rv != len) break;
+	}
+	return(tcnt);
+}
+
 #ifdef WINDOWS
 /*
  * wrapper for file seeking in WINDOWS API to hind the ugle 32 bit
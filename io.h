@@ -46,10 +46,22 @@
 #ifdef WINDOWS
 #define CLOSE(fd) CloseHandle(fd)
 typedef HANDLE fd_t;
+typedef struct io_vec {
+	void *iov_base;
+	unsigned long iov_len;
+} io_vec_t;
 #else
 #include <stdio.h>
+#include <limits.h>
+#include <sys/uio.h>
 #define CLOSE(fd) close(fd)
 typedef int fd_t;
+typedef struct iovec io_vec_t;
+#endif
+
+/* max segments handed to the system in a single vectored transfer */
+#ifndef IOV_MAX
+#define IOV_MAX 1024
 #endif
 
 fd_t Open(const char *, const OFF_T);
@@ -57,6 +69,9 @@ OFF_T Seek(fd_t, OFF_T);
 OFF_T SeekEnd(fd_t);
 long Write(fd_t, const void *, const unsigned long);
 long Read(fd_t, void *, const unsigned long);
+long WriteAt(fd_t, const void *, const unsigned long, const OFF_T);
+long ReadAt(fd_t, void *, const unsigned long, const OFF_T);
+long WriteVAt(fd_t, const io_vec_t *, const int, const OFF_T);
 int Sync (fd_t);
 
 #endif /* IO_H_ */
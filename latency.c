@@ -0,0 +1,169 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifdef WINDOWS
+#include <windows.h>
+#endif
+#include <string.h>
+
+#include "defs.h"
+#include "main.h"
+#include "latency.h"
+
+/*
+ * Values below LAT_LINEAR have a bucket each.  Above that, each power of
+ * two is split into LAT_LINEAR/2 buckets, so a bucket is never wider then
+ * 1/64th of the values in it.
+ */
+#define LAT_LINEAR		(1 << LAT_SUB_BITS)
+#define LAT_HALF		(LAT_LINEAR >> 1)
+
+static unsigned int msb64(unsigned long long v)
+{
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(v);
+#else
+	unsigned int m = 0;
+
+	while(v >>= 1) m++;
+	return m;
+#endif
+}
+
+static unsigned int bucket_of(OFF_T ns)
+{
+	unsigned long long v = (unsigned long long) ns;
+	unsigned int shift, idx;
+
+	if(v < LAT_LINEAR) return (unsigned int) v;
+	shift = msb64(v) - (LAT_SUB_BITS-1);
+	idx = shift*LAT_HALF + (unsigned int) (v >> shift);
+	return (idx < LAT_BUCKETS) ? idx : LAT_BUCKETS-1;
+}
+
+static OFF_T bucket_low(const unsigned int idx)
+{
+	unsigned int shift;
+
+	if(idx < LAT_LINEAR) return idx;
+	shift = idx/LAT_HALF - 1;
+	return ((OFF_T) (idx - shift*LAT_HALF)) << shift;
+}
+
+static OFF_T bucket_high(const unsigned int idx)
+{
+	unsigned int shift;
+
+	if(idx < LAT_LINEAR) return idx;
+	shift = idx/LAT_HALF - 1;
+	return bucket_low(idx) + (((OFF_T) 1) << shift) - 1;
+}
+
+void LatencyRecord(latency_t *lat, OFF_T ns)
+{
+	if(ns < 0) ns = 0;
+	lat->bucket[bucket_of(ns)]++;
+	lat->count++;
+	lat->sum += ns;
+}
+
+void LatencyClear(latency_t *lat)
+{
+	memset(lat, 0, sizeof(latency_t));
+}
+
+void LatencyAdd(latency_t *lat, const latency_t *from)
+{
+	unsigned int i;
+
+	for(i=0;i<LAT_BUCKETS;i++) {
+		lat->bucket[i] += from->bucket[i];
+	}
+	lat->count += from->count;
+	lat->sum += from->sum;
+}
+
+void LatencySub(latency_t *lat, const latency_t *from)
+{
+	unsigned int i;
+
+	for(i=0;i<LAT_BUCKETS;i++) {
+		lat->bucket[i] -= from->bucket[i];
+	}
+	lat->count -= from->count;
+	lat->sum -= from->sum;
+}
+
+/*
+ * min and max are the lowest and highest values the end buckets hold
+ */
+OFF_T LatencyMin(const latency_t *lat)
+{
+	unsigned int i;
+
+	for(i=0;i<LAT_BUCKETS;i++) {
+		if(lat->bucket[i] > 0) return bucket_low(i);
+	}
+	return 0;
+}
+
+OFF_T LatencyMax(const latency_t *lat)
+{
+	unsigned int i;
+
+	for(i=LAT_BUCKETS;i>0;i--) {
+		if(lat->bucket[i-1] > 0) return bucket_high(i-1);
+	}
+	return 0;
+}
+
+double LatencyMean(const latency_t *lat)
+{
+	return (lat->count > 0) ? (double) lat->sum / (double) lat->count : 0.0;
+}
+
+/*
+ * The highest value in the bucket holding the pct'th percentile
+ */
+OFF_T LatencyPercentile(const latency_t *lat, const double pct)
+{
+	OFF_T want, seen = 0;
+	unsigned int i;
+
+	if(lat->count <= 0) return 0;
+	/* the count at or below the percentile, rounded up */
+	want = (OFF_T) ((pct / 100.0) * (double) lat->count);
+	if((double) want < (pct / 100.0) * (double) lat->count) want++;
+	if(want < 1) want = 1;
+	for(i=0;i<LAT_BUCKETS;i++) {
+		seen += lat->bucket[i];
+		if(seen >= want) return bucket_high(i);
+	}
+	return LatencyMax(lat);
+}
@@ -0,0 +1,50 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifndef _LATENCY_H
+#define _LATENCY_H 1
+
+#include "defs.h"
+#include "main.h"
+
+/*
+ * Log linear latency histograms, in nsecs from getMonoTime.  Each thread
+ * records into its own, and they are summed for the heartbeat, cycle
+ * and total stats.
+ */
+void LatencyRecord(latency_t *, OFF_T);
+void LatencyClear(latency_t *);
+void LatencyAdd(latency_t *, const latency_t *);
+void LatencySub(latency_t *, const latency_t *);
+OFF_T LatencyMin(const latency_t *);
+OFF_T LatencyMax(const latency_t *);
+double LatencyMean(const latency_t *);
+OFF_T LatencyPercentile(const latency_t *, const double);
+
+#endif /* _LATENCY_H */
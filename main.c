@@ -59,6 +59,10 @@
 #include "timer.h"
 #include "stats.h"
 #include "signals.h"
+#include "pattern.h"
+#include "arena.h"
+#include "statlog.h"
+#include "rate.h"
 
 /* global */
 child_args_t cleanArgs;
@@ -67,8 +71,6 @@ char hostname[HOSTNAME_SIZE]; /* global system hostname */
 
 void linear_read_write_test(test_ll_t *test)
 {
-	int i;
-
 	if(test->args->flags & CLD_FLG_W) {
 		test->env->bContinue = TRUE;
 		test->env->request_lba.wLBA = test->args->start_lba;
@@ -77,8 +79,7 @@ void linear_read_write_test(test_ll_t *test)
 		test->args->test_state = SET_OPER_W(test->args->test_state);
 		test->args->test_state = SET_wFST_TIME(test->args->test_state);
 /* 		srand(test->args->seed);	* reseed so we can re create the same random transfers */
-		memset(test->env->action_list,0,sizeof(action_t)*test->args->t_kids);
-		test->env->action_list_entry = 0;
+		clear_action_list(test->env, test->args);
 		test->env->wcount = 0;
 		test->env->gw_start_time = 0;
 		test->env->gw_stop_time = 0;
@@ -91,12 +92,8 @@ void linear_read_write_test(test_ll_t *test)
 		else {
 			pMsg(INFO,test->args, "Starting write pass\n");
 		}
-		CreateTestChild(ChildTimer, test);
-		for(i=0;i<test->args->t_kids;i++) {
-			CreateTestChild(ChildMain, test);
-		}
-		/* Wait for the writers to finish */
-		cleanUpTestChildren(test);
+		/* Run the pool as writers, and wait for them to finish */
+		RunTestPool(test);
 	}
 
 	/* If the write test failed don't start the read test */
@@ -110,8 +107,7 @@ void linear_read_write_test(test_ll_t *test)
 		test->args->test_state = SET_OPER_R(test->args->test_state);
 		test->args->test_state = SET_rFST_TIME(test->args->test_state);
 /* 		srand(test->args->seed);	* reseed so we can re create the same random transfers */
-		memset(test->env->action_list,0,sizeof(action_t)*test->args->t_kids);
-		test->env->action_list_entry = 0;
+		clear_action_list(test->env, test->args);
 		test->env->rcount = 0;
 		test->env->gr_start_time = 0;
 		test->env->gr_stop_time = 0;
@@ -124,12 +120,8 @@ void linear_read_write_test(test_ll_t *test)
 		else {
 			pMsg(INFO,test->args, "Starting read pass\n");
 		}
-		CreateTestChild(ChildTimer, test);
-		for(i=0;i<test->args->t_kids;i++) {
-			CreateTestChild(ChildMain, test);
-		}
-		/* Wait for the readers to finish */
-		cleanUpTestChildren(test);
+		/* Run the pool as readers, and wait for them to finish */
+		RunTestPool(test);
 	}
 }
 
@@ -138,6 +130,8 @@ unsigned long init_data(test_ll_t *test, unsigned char **data_buffer_unaligned)
 	int i;
 
 	unsigned long data_buffer_size;
+	unsigned long io_buffer_size;
+	unsigned int io_buffers;
 
 #ifdef WINDOWS
 	if(CreateMutex(NULL, FALSE, "gbl") == NULL) {
@@ -156,34 +150,99 @@ unsigned long init_data(test_ll_t *test, unsigned char **data_buffer_unaligned)
 		pMsg(ERR, test->args, "Failed to create semaphore, error = %u\n", GetLastError());
 		return(GetLastError());
 	}
+	if((test->env->mutexs.CondACTION = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL) {
+		pMsg(ERR, test->args, "Failed to create event, error = %u\n", GetLastError());
+		return(GetLastError());
+	}
+	if((test->env->mutexs.MutexPOOL = CreateMutex(NULL, FALSE, NULL)) == NULL) {
+		pMsg(ERR, test->args, "Failed to create semaphore, error = %u\n", GetLastError());
+		return(GetLastError());
+	}
+	if((test->env->mutexs.CondPOOL = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL) {
+		pMsg(ERR, test->args, "Failed to create event, error = %u\n", GetLastError());
+		return(GetLastError());
+	}
+	if((test->env->mutexs.SemDONE = CreateSemaphore(NULL, 0, 1, NULL)) == NULL) {
+		pMsg(ERR, test->args, "Failed to create semaphore, error = %u\n", GetLastError());
+		return(GetLastError());
+	}
 #else
 
-	mutexs_t mutexs = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER };
+	mutexs_t mutexs = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+						PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
 	test->env->mutexs = mutexs;
+	if(sem_init(&test->env->mutexs.SemDONE, 0, 0) != 0) {
+		pMsg(ERR, test->args, "Failed to create semaphore, errno = %u\n", GETLASTERROR());
+		return(GETLASTERROR());
+	}
 
 #endif
 
 	if(test->args->seed == 0) test->args->seed = test->args->pid;
 	srand(test->args->seed);
 
+	if(initAffinity(test) < 0) {
+		return(-1);
+	}
+
+	for(i = 0; i < RATE_BUCKETS; i++) {
+		RateInit(&test->env->rate[i], test->args->rate_cap[i]);
+	}
+
 	/* create bitmap to hold write/read context: each bit is an LBA */
 	/* the stuff before BMP_OFFSET is the data for child/thread shared context */
-	test->env->bmp_siz = (((((size_t)test->args->vsiz)/test->args->ltrsiz)/8) == 0) ? 1 : ((((size_t)test->args->vsiz)/test->args->ltrsiz)/8);
-	if (((test->args->vsiz/test->args->ltrsiz)/8) != 0) test->env->bmp_siz += 1;    /* account for rounding error */
+	/* it is updated a word at a time, so round up to whole words */
+	test->env->bmp_siz = (((((size_t)test->args->vsiz)/test->args->ltrsiz)/BMP_WORD_BITS)+1)*sizeof(bmp_word_t);
 
 	/* We use that same data buffer for static data, so alloc here. */
 	data_buffer_size = ((test->args->htrsiz*BLK_SIZE)*2);
-	if((*data_buffer_unaligned = (unsigned char *) ALLOC(data_buffer_size+ALIGNSIZE)) == NULL) {
+	if(test->args->flags & CLD_FLG_ARENA) {
+		/* each child has two IO buffers, and a buffer per slot when async */
+		io_buffers = (test->args->flags & CLD_FLG_ASYNC) ? test->args->io_depth+2 : 2;
+		io_buffer_size = ((test->args->htrsiz*BLK_SIZE+ALIGNSIZE-1)/ALIGNSIZE)*ALIGNSIZE;
+		if((test->env->arena = ArenaOpen(data_buffer_size+io_buffer_size*io_buffers*test->args->t_kids, io_buffers*test->args->t_kids+1)) == NULL) {
+			pMsg(ERR,test->args,  "Failed to map IO buffer arena, errno = %u\n", GETLASTERROR());
+			return(-1);
+		}
+		test->env->data_buffer = (unsigned char *) ArenaAlloc(test->env->arena, data_buffer_size);
+		pMsg(INFO,test->args, "IO buffers are backed by %s pages\n", ArenaPages(test->env->arena));
+	}
+	if(test->env->data_buffer == NULL) {
+		if((*data_buffer_unaligned = (unsigned char *) ALLOC(data_buffer_size+ALIGNSIZE)) == NULL) {
+			pMsg(ERR,test->args,  "Failed to allocate static data buffer memory.\n");
+			return(-1);
+		}
+		test->env->data_buffer = (unsigned char *) BUFALIGN(*data_buffer_unaligned);
+	}
+	/* create list to hold lbas currently be written */
+	if((test->env->action_list = (action_node_t *) ALLOC(sizeof(action_node_t)*test->args->t_kids*test->args->io_depth)) == NULL) {
 		pMsg(ERR,test->args,  "Failed to allocate static data buffer memory.\n");
 		return(-1);
 	}
-	/* create list to hold lbas currently be written */
-	if((test->env->action_list = (action_t *) ALLOC(sizeof(action_t)*test->args->t_kids)) == NULL) {
+	/* at least twice as many hash buckets as there can be actions in use */
+	for(test->env->action_hash_mask = 1; test->env->action_hash_mask < (2*test->args->t_kids*test->args->io_depth); test->env->action_hash_mask <<= 1);
+	if((test->env->action_hash = (action_node_t **) ALLOC(sizeof(action_node_t *)*test->env->action_hash_mask)) == NULL) {
 		pMsg(ERR,test->args,  "Failed to allocate static data buffer memory.\n");
 		return(-1);
 	}
-	
-	test->env->data_buffer = (unsigned char *) BUFALIGN(*data_buffer_unaligned);
+	test->env->action_hash_mask--;
+	/* one cache line of IO counts for each child */
+	if((test->env->thread_stats_mem = ALLOC(sizeof(thread_stats_t)*(test->args->t_kids+1))) == NULL) {
+		pMsg(ERR,test->args,  "Failed to allocate static data buffer memory.\n");
+		return(-1);
+	}
+	test->env->thread_stats = (thread_stats_t *) CACHEALIGN(test->env->thread_stats_mem);
+	memset(test->env->thread_stats,0,sizeof(thread_stats_t)*test->args->t_kids);
+	/* a read and a write histogram for each child, then the base, heartbeat, cycle and total ones */
+	if((test->env->thread_lat = (latency_t *) ALLOC(sizeof(latency_t)*2*(test->args->t_kids+4))) == NULL) {
+		pMsg(ERR,test->args,  "Failed to allocate latency histogram memory.\n");
+		return(-1);
+	}
+	memset(test->env->thread_lat,0,sizeof(latency_t)*2*(test->args->t_kids+4));
+	test->env->lat_base = test->env->thread_lat + 2*test->args->t_kids;
+	test->env->hbeat_lat = test->env->lat_base + 2;
+	test->env->cycle_lat = test->env->hbeat_lat + 2;
+	test->env->global_lat = test->env->cycle_lat + 2;
 
 	if((test->env->shared_mem = (void *) ALLOC(test->env->bmp_siz+BMP_OFFSET)) == NULL) {
 		pMsg(ERR, test->args, "Failed to allocate bitmap memory\n");
@@ -192,8 +251,7 @@ unsigned long init_data(test_ll_t *test, unsigned char **data_buffer_unaligned)
 
 	memset(test->env->shared_mem,0,test->env->bmp_siz+BMP_OFFSET);
 	memset(test->env->data_buffer,0,data_buffer_size);
-	memset(test->env->action_list,0,sizeof(action_t)*test->args->t_kids);
-	test->env->action_list_entry = 0;
+	clear_action_list(test->env, test->args);
 
 	test->env->request_lba.rLBA = test->env->request_lba.wLBA = test->args->start_lba;
 	test->args->test_state = SET_STS_PASS(test->args->test_state);
@@ -218,11 +276,9 @@ unsigned long init_data(test_ll_t *test, unsigned char **data_buffer_unaligned)
 			if(i == sizeof(test->args->pattern)) i = 0;
 			fill_buffer(test->env->data_buffer, data_buffer_size, &test->args->pattern, sizeof(test->args->pattern)-i, CLD_FLG_FPTYPE);
 			break;
-		case CLD_FLG_RPTYPE :
-			fill_buffer(test->env->data_buffer, data_buffer_size, NULL, 0, CLD_FLG_RPTYPE);
-			break;
 		case CLD_FLG_CPTYPE :
 			fill_buffer(test->env->data_buffer, data_buffer_size, 0, 0, CLD_FLG_CPTYPE);
+		case CLD_FLG_RPTYPE :	/* random and lba data are made for each transfer */
 		case CLD_FLG_LPTYPE :
 			break;
 		default :
@@ -245,7 +301,6 @@ void *threadedMain(void *vtest)
 
 	unsigned char *data_buffer_unaligned = NULL;
 	unsigned long ulRV;
-	int i;
 	unsigned char *sharedMem;
 
 	extern unsigned long glb_run;
@@ -281,6 +336,10 @@ void *threadedMain(void *vtest)
 	}
 
 	pMsg(START, test->args, "Start args: %s\n", test->args->argstr);
+	reportAffinity(test);
+
+	/* the children are created once, and run each pass */
+	CreateTestPool(test);
 
 	/*
 	 * This loop takes care of passes
@@ -288,9 +347,7 @@ void *threadedMain(void *vtest)
 	do {
 		test->env->pass_count++;
 		test->env->start_time = time(NULL);
-		if(test->args->flags & CLD_FLG_RPTYPE) { /* force random data to be different each cycle */
-			fill_buffer(test->env->data_buffer, ((test->args->htrsiz*BLK_SIZE)*2), NULL, 0, CLD_FLG_RPTYPE);
-		}
+		test->env->start_mono = getMonoTime();
 		sharedMem = test->env->shared_mem;
 		memset(sharedMem+BMP_OFFSET,0,test->env->bmp_siz);
 		if((test->args->flags & CLD_FLG_LINEAR) && !(test->args->flags & CLD_FLG_NTRLVD)) {
@@ -310,8 +367,7 @@ void *threadedMain(void *vtest)
 				test->env->lastAction.oper = READER;
 				test->args->test_state = SET_OPER_R(test->args->test_state);
 			}
-			memset(test->env->action_list,0,sizeof(action_t)*test->args->t_kids);
-			test->env->action_list_entry = 0;
+			clear_action_list(test->env, test->args);
 			test->env->wcount = 0;
 			test->env->rcount = 0;
 			test->env->gr_start_time = 0;
@@ -329,18 +385,17 @@ void *threadedMain(void *vtest)
 				pMsg(INFO,test->args, "Starting pass\n");
 			}
 
-			CreateTestChild(ChildTimer, test);
-			for(i=0;i<test->args->t_kids;i++) {
-				CreateTestChild(ChildMain, test);
-			}
-			/* Wait for the children to finish */
-			cleanUpTestChildren(test);
+			/* Run the pool, and wait for it to finish */
+			RunTestPool(test);
 		}
 
 		update_cyc_stats(test->args, test->env);
 		if((test->args->flags & CLD_FLG_CYC) && (test->args->flags & CLD_FLG_PCYC)) {
 			print_stats(test->args, test->env, CYCLE);
 		}
+		if(test->args->flags & CLD_FLG_CYC) {
+			log_stats(test->args, test->env, CYCLE);
+		}
 		update_gbl_stats(test->env);
 
 		if(signal_action & SIGNAL_STOP) { break; }	/* user request to stop */
@@ -354,15 +409,24 @@ void *threadedMain(void *vtest)
 			}
 		}
 	} while(TST_STS(test->args->test_state));
+	cleanUpTestPool(test);
 	print_stats(test->args, test->env, TOTAL);
+	log_stats(test->args, test->env, TOTAL);
 
-	FREE(data_buffer_unaligned);
+	if(data_buffer_unaligned) FREE(data_buffer_unaligned);
+	ArenaClose(test->env->arena);
 	FREE(test->env->shared_mem);
 #ifdef WINDOWS
 	CloseHandle(OpenMutex(SYNCHRONIZE, TRUE, "gbl"));
 	CloseHandle(test->env->mutexs.MutexACTION);
 	CloseHandle(test->env->mutexs.MutexIO);
 	CloseHandle(test->env->mutexs.MutexSTATS);
+	CloseHandle(test->env->mutexs.CondACTION);
+	CloseHandle(test->env->mutexs.MutexPOOL);
+	CloseHandle(test->env->mutexs.CondPOOL);
+	CloseHandle(test->env->mutexs.SemDONE);
+#else
+	sem_destroy(&test->env->mutexs.SemDONE);
 #endif
 
 	if(TST_STS(test->args->test_state)) {
@@ -485,7 +549,7 @@ test_ll_t *run() {
 
 int main(int argc, char **argv)
 {
-	extern time_t global_start_time;
+	extern OFF_T global_start_time;
 	extern unsigned long glb_flags;	/* global flags GLB_FLG_xxx */
 	int i;
 
@@ -503,6 +567,7 @@ int main(int argc, char **argv)
 #endif
 
 	setup_sig_mask();
+	PatternInit();
 
 	memset(hostname, 0, HOSTNAME_SIZE);
 	gethostname(hostname, HOSTNAME_SIZE);
@@ -510,7 +575,7 @@ int main(int argc, char **argv)
 	setbuf(stdout, (char *)NULL);
 
 	glb_flags = 0;
-	global_start_time = time(NULL);
+	global_start_time = getMonoTime();
 
 	strncpy(cleanArgs.device, "No filespec", strlen("No filespec"));
 	cleanArgs.stop_lba = -1;
@@ -527,8 +592,17 @@ int main(int argc, char **argv)
 
 	if(fill_cld_args(argc, argv, &cleanArgs) < 0) return(-1);
 
+	if(cleanArgs.stat_log[0] && (StatLogOpen(cleanArgs.stat_log) < 0)) {
+		pMsg(ERR, &cleanArgs, "Could not open stats records %s, errno = %u\n", cleanArgs.stat_log, GETLASTERROR());
+		return(-1);
+	}
+
 	cleanUp(run());
 
+	if(StatLogClose() > 0) {
+		pMsg(WARN, &cleanArgs, "Stats records were dropped, the -O reader could not keep up\n");
+	}
+
 #ifdef WINDOWS
     WSACleanup();
 #endif
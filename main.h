@@ -37,6 +37,7 @@
 #include <sys/stat.h>
 #else
 #include <pthread.h>
+#include <semaphore.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -56,10 +57,16 @@
 #define BLKSSZGET    _IO(0x12,104)			/* ALT IOCTL for getting the device size */
 
 #define DEV_NAME_LEN		80		/* max character for target name */
+#define CPU_LIST_LEN		128		/* max character for a CPU list, -b */
+#define STAT_LOG_LEN		256		/* max character for the stats record destination, -O */
 #define MAX_ARG_LEN			160		/* max length of command line arguments for startarg display */
 #define HOSTNAME_SIZE		16		/* number of hostname characters used in mark header */
+#define MARK_HDR_SIZE		(32+HOSTNAME_SIZE+DEV_NAME_LEN)	/* max bytes of the fields at the start of a marked LBA */
+#define MARK_CRC_OFF		MARK_HDR_SIZE	/* byte offset of the CRC32C in a marked LBA, -mc */
+#define DEDUPE_BLKS			8		/* LBAs in a dedupe chunk, for -Z */
 #define BLK_SIZE			512		/* default size of an LBA in bytes */
 #define ALIGNSIZE			4096	/* memory alignment size in bytes */
+#define CACHE_LINE_SIZE		64		/* size in bytes of a cpu cache line */
 #define DEFAULT_IO_TIMEOUT	120		/* the default number of seconds before IO timeout */
 
 /* the new way we align */
@@ -75,6 +82,8 @@
 #define BUFALIGN(x) (void *) (((unsigned long)x + (ALIGNSIZE - 1)) & ~(ALIGNSIZE - 1))
 #endif
 
+#define CACHEALIGN(x) (void *) (((size_t)x + (CACHE_LINE_SIZE - 1)) & ~((size_t)CACHE_LINE_SIZE - 1))
+
 #define MASK(x,y) (x & y)
 
 /* each is a 64b number.  offsets are in 8B*offset placement */
@@ -82,6 +91,9 @@
 #define OFF_WLBA	1	/* offset in memseg of current write LBA */
 
 #define BMP_OFFSET	2*sizeof(OFF_T)		/* bitmap starts here */
+#define BMP_WORD_BITS	64				/* bits in each word of the bitmap */
+
+typedef unsigned long long bmp_word_t;
 
 #define TST_STS(x)			(x & 0x1)	/* current testing status */
 #define SET_STS_PASS(x)		(x | 0x01)
@@ -176,11 +188,27 @@
 #define CLD_FLG_TMO_ERROR	0x0001000000000000ULL	/* make an IO TIMEOUT warning, fail the IO test */
 #define CLD_FLG_UNIQ_WRT	0x0002000000000000ULL	/* garentees that every write is unique */
 
+/* Async IO Engine Flags */
+#define CLD_FLG_URING		0x0008000000000000ULL	/* child IO is issued through io_uring */
+#define CLD_FLG_LIBAIO		0x0010000000000000ULL	/* child IO is issued through linux native aio */
+#define CLD_FLG_ASYNC	(CLD_FLG_URING|CLD_FLG_LIBAIO)
+
+#define CLD_FLG_VECTOR		0x0020000000000000ULL	/* marked writes are sent as a gather list of header and payload */
+#define CLD_FLG_LBA_DISP	0x0040000000000000ULL	/* LBAs are handed out from an atomic cursor, not under MutexACTION */
+#define CLD_FLG_MRK_CRC		0x0080000000000000ULL	/* enable adding a CRC32C of the LBA to mark data */
+#define CLD_FLG_ARENA		0x0100000000000000ULL	/* IO buffers come from a huge page arena shared by the target */
+#define CLD_FLG_AFFINITY	0x0200000000000000ULL	/* test threads and timer are bound to CPUs, -b */
+#define CLD_FLG_RATE		0x0400000000000000ULL	/* IO is held to IOPS and bandwidth caps, -l */
+#define CLD_FLG_OPEN		0x0800000000000000ULL	/* IO is issued on an arrival schedule, not as the last IO completes, -g */
+#define CLD_FLG_POISSON		0x1000000000000000ULL	/* arrivals are a Poisson process, rather than evenly spaced */
+
 /* startup defaults */
 #define TRSIZ	1		/* default transfer size in blocks */
 #define VSIZ	2000	/* default volume capacity in LBAs */
 #define SEEKS	1000	/* default seeks */
 #define KIDS	4		/* default number of children */
+#define IO_DEPTH	8	/* default number of IOs a child keeps in flight with async IO */
+#define MAX_IO_DEPTH	4096	/* max number of IOs a child can keep in flight */
 
 #ifdef WINDOWS
 typedef HANDLE hThread_t;
@@ -194,6 +222,12 @@ typedef struct thread_struct {
 	struct thread_struct *next; /* pointer to next thread */
 } thread_struct_t;
 
+/* CPUs that threads are bound to, count is 0 when they are not bound */
+typedef struct cpu_list {
+	unsigned int count;
+	unsigned int *cpu;
+} cpu_list_t;
+
 typedef struct stats {
 	OFF_T wcount;
 	OFF_T rcount;
@@ -201,8 +235,60 @@ typedef struct stats {
 	OFF_T rbytes;
 	double wtime;
 	double rtime;
+	OFF_T werrors;
+	OFF_T rerrors;
+	OFF_T retries;
 } stats_t;
 
+/*
+ * IO counts kept by each test thread, only the owning thread updates
+ * them, so they are padded out to keep threads off each others cache line
+ */
+typedef struct thread_stats {
+	OFF_T wcount;
+	OFF_T rcount;
+	OFF_T wbytes;
+	OFF_T rbytes;
+	OFF_T werrors;				/* transfers that failed, after any retries */
+	OFF_T rerrors;
+	OFF_T retries;				/* transfers retried after a failure */
+	unsigned int inflight;		/* transfers issued and not yet complete */
+	unsigned char pad[CACHE_LINE_SIZE-(7*sizeof(OFF_T))-sizeof(unsigned int)];
+} thread_stats_t;
+
+/*
+ * IO latency histogram, see latency.c.  Buckets are log linear, with
+ * 2^LAT_SUB_BITS linear buckets, and latencies up to 2^LAT_MAX_BITS nsecs.
+ */
+#define LAT_SUB_BITS	7
+#define LAT_MAX_BITS	40
+#define LAT_BUCKETS		((LAT_MAX_BITS-LAT_SUB_BITS+2)*(1 << (LAT_SUB_BITS-1)))
+
+typedef struct latency {
+	OFF_T count;
+	OFF_T sum;					/* nsecs */
+	OFF_T bucket[LAT_BUCKETS];
+} latency_t;
+
+/*
+ * Rate caps, -l, are kept for writes, reads, and all IO to a target,
+ * each as an IOPS and a bandwidth token bucket.
+ */
+#define RATE_ALL		2		/* after WRITER and READER */
+#define RATE_IOPS(op)	(2*(op))
+#define RATE_BW(op)		((2*(op))+1)
+#define RATE_BUCKETS	6
+
+/*
+ * A token bucket, kept as the time its tokens have been spent up to,
+ * or an arrival schedule, kept as the time of the next arrival.  Both
+ * are shared by the children of a target without a lock.
+ */
+typedef struct rate {
+	OFF_T tat;					/* nsecs from getMonoTime */
+	double cost;				/* nsecs of tokens an IO, or a byte, takes, 0 if there is no cap */
+} rate_t;
+
 typedef struct child_args {
 	char device[DEV_NAME_LEN];	/* device name */
 	char argstr[MAX_ARG_LEN];	/* human readable argument string /w assumtions */
@@ -236,6 +322,15 @@ typedef struct child_args {
 	time_t ioTimeout;			/* the time (sec) before failure do to possible hung IO */
 	unsigned long sync_interval;/* number of write IOs before issuing a sync */
 	long retry_delay;			/* number of msec to wait before retrying an IO */
+	unsigned int io_depth;		/* number of IOs each child keeps in flight */
+	unsigned int rand_len;		/* bytes of random data at the start of each LBA, the rest are zero */
+	double dedupe_ratio;		/* target dedupe ratio for random data */
+	OFF_T dedupe_chunks;		/* number of different dedupe chunks, 0 if every chunk is different */
+	char child_cpus[CPU_LIST_LEN];	/* CPUs for the test threads, or "n" for the target's NUMA node */
+	char timer_cpus[CPU_LIST_LEN];	/* CPUs for the timer thread, empty for the test threads' CPUs */
+	char stat_log[STAT_LOG_LEN];	/* stats record format and destination, -O */
+	OFF_T rate_cap[RATE_BUCKETS];	/* IOPS and bytes per second caps, indexed by RATE_IOPS and RATE_BW, -l */
+	OFF_T arrival_rate;			/* IOs a second arriving in open loop mode, -g */
 } child_args_t;
 
 typedef struct mutexs {
@@ -243,10 +338,18 @@ typedef struct mutexs {
 	HANDLE MutexACTION;			/* mutex for the entire target device */
 	HANDLE MutexIO;				/* mutex for the IO to the device */
 	HANDLE MutexSTATS;			/* mutex for IO stats to the device */
+	HANDLE CondACTION;			/* event set when an action in use is released */
+	HANDLE MutexPOOL;			/* mutex for the pass generation and active pool children */
+	HANDLE CondPOOL;			/* event set when a pass is started, or the pool told to exit */
+	HANDLE SemDONE;				/* posted when the last pool child finishes a pass */
 #else
 	pthread_mutex_t MutexACTION; /* mutex for the entire target device */
 	pthread_mutex_t MutexIO;	/* mutex for the IO to the device */
 	pthread_mutex_t MutexSTATS;		/* mutex for IO stats to the device */
+	pthread_cond_t CondACTION;		/* signaled when an action in use is released */
+	pthread_mutex_t MutexPOOL;		/* mutex for the pass generation and active pool children */
+	pthread_cond_t CondPOOL;		/* signaled when a pass is started, or the pool told to exit */
+	sem_t SemDONE;					/* posted when the last pool child finishes a pass */
 #endif
 } mutexs_t;
 
@@ -255,29 +358,59 @@ typedef struct lba {
        OFF_T wLBA;              /* The write block number */
 } lba_t;
 
+typedef struct action_node {
+	action_t action;
+	struct action_node *next;	/* next action hashed to the same bucket */
+} action_node_t;
+
 typedef struct test_env {
 	void *shared_mem;           /* global pointer to shared memory */
 	unsigned char *data_buffer; /* global data buffer */
+	struct arena *arena;		/* IO buffer arena, with -I h */
 	size_t bmp_siz;             /* size of bitmask */
 	BOOL bContinue;             /* global that when set to false will force exit for this environment */
 	OFF_T pass_count;           /* pass counters */
 	stats_t hbeat_stats;        /* per heartbeat statistics */
 	stats_t cycle_stats;        /* per cycle statistics */
 	stats_t global_stats;       /* per env statistics */
+	stats_t stats_base;         /* sum of thread_stats already moved to cycle_stats */
+	thread_stats_t *thread_stats;	/* per thread IO counts, one per test child */
+	void *thread_stats_mem;     /* unaligned memory behind thread_stats */
+	latency_t *thread_lat;		/* per thread latency, indexed by thread*2+oper */
+	latency_t *lat_base;		/* sum of thread_lat already moved to cycle_lat, indexed by oper */
+	latency_t *hbeat_lat;		/* per heartbeat latency */
+	latency_t *cycle_lat;		/* per cycle latency */
+	latency_t *global_lat;		/* per env latency */
+	rate_t rate[RATE_BUCKETS];	/* token buckets for the -l caps, indexed by RATE_IOPS and RATE_BW */
+	rate_t arrival;				/* open loop arrival schedule, -g */
 	OFF_T rcount;				/* number of read IO operations */
 	OFF_T wcount;				/* number of write IO operations */
 	unsigned short kids;		/* number of test child processes */
 	thread_struct_t *pThreads;  /* List of child test processes */
+	thread_struct_t *pPool;     /* List of pool children, kept for every pass */
+	unsigned int active;        /* number of pool children still running this pass, under MutexPOOL */
+	unsigned int pass_gen;      /* bumped under MutexPOOL to start each pass, and to exit the pool */
+	BOOL bPoolExit;             /* when set, pool children exit instead of starting a pass */
 	time_t start_time;			/*	overall start time of test	*/
+	OFF_T start_mono;			/*	start of this pass, nsecs from getMonoTime	*/
 	time_t end_time;			/*	overall end time of test	*/
 	action_t lastAction;		/* when interleaving tests, tells the threads whcih action was last */
-	action_t *action_list;		/* pointer to list of actions that are currently in use */
-	int action_list_entry;		/* where in the action_list we are */
+	action_node_t *action_list;	/* pool of entries for actions that are currently in use */
+	action_node_t **action_hash;	/* actions in use, hashed on the LBA region they start in */
+	action_node_t *action_free;	/* entries in action_list that are not in use */
+	unsigned int action_hash_mask;	/* number of hash buckets - 1 */
+	int action_list_entry;		/* number of actions in use */
+	unsigned int action_release;	/* bumped each time an action in use is released */
+	unsigned int action_waiters;	/* number of threads waiting on CondACTION */
+	unsigned int child_count;	/* number of test children started, used to index each child */
+	cpu_list_t child_cpus;		/* test children are bound round robin to these CPUs */
+	cpu_list_t timer_cpus;		/* the timer is bound to all of these CPUs */
+	int numa_node;				/* node the target is attached to, with -b n, or -1 */
     lba_t request_lba;          /* which lba is the next requested */
-	unsigned long gr_start_time;	/* start time IO */
-	unsigned long gw_start_time;	/* start time IO */
-	unsigned long gr_stop_time;		/* stop time IO */
-	unsigned long gw_stop_time;		/* stop time IO */
+	OFF_T gr_start_time;		/* start time IO, nsecs from getMonoTime */
+	OFF_T gw_start_time;		/* start time IO */
+	OFF_T gr_stop_time;			/* stop time IO */
+	OFF_T gw_stop_time;			/* stop time IO */
 	mutexs_t mutexs;
 } test_env_t;
 
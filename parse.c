@@ -44,6 +44,27 @@
 #include "sfunc.h"
 #include "parse.h"
 
+/*
+ * reads a number with an optional k, m or g (2^10, 2^20, 2^30) or
+ * K, M or G (10^3, 10^6, 10^9) multiplier, end is left past it
+ */
+static OFF_T parse_rate(const char *str, char **end)
+{
+	OFF_T rate = (OFF_T) strtoull(str, end, 10);
+
+	switch(**end) {
+		case 'k' : rate <<= 10; break;
+		case 'K' : rate *= 1000; break;
+		case 'm' : rate <<= 20; break;
+		case 'M' : rate *= 1000000; break;
+		case 'g' : rate <<= 30; break;
+		case 'G' : rate *= 1000000000; break;
+		default : return rate;
+	}
+	(*end)++;
+	return rate;
+}
+
 int fill_cld_args(int argc, char **argv, child_args_t *args)
 {
 	extern char *optarg;
@@ -51,9 +72,11 @@ int fill_cld_args(int argc, char **argv, child_args_t *args)
 	extern unsigned long glb_flags;
 
 	signed char c;
-	char *leftovers;
+	char *leftovers, *p;
+	int op;
+	double ratio;
 
-	while((c = getopt(argc, argv, "?a:A:B:cC:dD:E:f:Fh:I:K:L:m:M:nN:o:p:P:qQrR:s:S:t:T:wvV:z")) != -1) {
+	while((c = getopt(argc, argv, "?a:A:b:B:cC:dD:E:f:Fg:h:I:K:l:L:m:M:nN:o:O:p:P:qQrR:s:S:t:T:wvV:zZ:")) != -1) {
 		switch(c) {
 			case ':' :
 				pMsg(WARN, args, "Missing argument for perameter.\n");
@@ -259,6 +282,59 @@ int fill_cld_args(int argc, char **argv, child_args_t *args)
 				}
 				args->flags |= CLD_FLG_RPTYPE;
 				break;
+			case 'Z' :
+				if(optarg == NULL) {
+					pMsg(WARN, args, "-%c option requires an argument.\n", c);
+					return(-1);
+				}
+				if(!isdigit(optarg[0])) {
+					pMsg(WARN, args, "-%c arguments is non numeric.\n", c);
+					usage();
+					return(-1);
+				}
+				ratio = strtod(optarg, &leftovers);
+				if(*leftovers == ':') {
+					args->dedupe_ratio = strtod(leftovers+1, NULL);
+				}
+				if((ratio < 1) || ((*leftovers == ':') && (args->dedupe_ratio < 1))) {
+					pMsg(WARN, args, "-%c ratios must be 1 or greater.\n", c);
+					return(-1);
+				}
+				/* only 1/ratio of each LBA is random, the rest is zeros */
+				args->rand_len = (unsigned int) ((BLK_SIZE / ratio) / sizeof(OFF_T)) * sizeof(OFF_T);
+				if(args->rand_len < sizeof(OFF_T)) {
+					args->rand_len = sizeof(OFF_T);
+				}
+				break;
+			case 'b' :
+				if(optarg == NULL) {
+					pMsg(WARN, args, "-%c option requires an argument.\n", c);
+					return(-1);
+				}
+#ifdef LINUX
+				if(strspn(optarg, "0123456789,-:n") != strlen(optarg)) {
+					pMsg(WARN, args, "-%c takes a list of CPUs, or n for the target's NUMA node.\n", c);
+					return(-1);
+				}
+				/* test thread CPUs, then optionally the timer's after a ':' */
+				if((leftovers = strchr(optarg, ':')) == NULL) {
+					leftovers = optarg + strlen(optarg);
+				}
+				if(((size_t) (leftovers-optarg) >= CPU_LIST_LEN) || (strlen(leftovers) > CPU_LIST_LEN)) {
+					pMsg(WARN, args, "-%c CPU list is too long.\n", c);
+					return(-1);
+				}
+				strncpy(args->child_cpus, optarg, leftovers-optarg);
+				args->child_cpus[leftovers-optarg] = '\0';
+				if(*leftovers == ':') {
+					strncpy(args->timer_cpus, leftovers+1, CPU_LIST_LEN-1);
+				}
+				args->flags |= CLD_FLG_AFFINITY;
+#else
+				pMsg(ERR, args, "Binding threads to CPUs is only supported on Linux\n");
+				return(-1);
+#endif
+				break;
 			case 'h' :
 				if(optarg == NULL) {
 					pMsg(WARN, args, "-%c option requires an argument.\n", c);
@@ -307,6 +383,70 @@ int fill_cld_args(int argc, char **argv, child_args_t *args)
 				args->offset = atol(optarg);
 				args->flags |= CLD_FLG_OFFSET;
 				break;
+			case 'g' :
+				if(optarg == NULL) {
+					pMsg(WARN, args, "-%c option requires an argument.\n", c);
+					return(-1);
+				}
+				/* open loop arrivals a second, evenly spaced, f, or Poisson, p */
+				args->arrival_rate = parse_rate(optarg, &leftovers);
+				if(*leftovers == ':') {
+					switch(*++leftovers) {
+						case 'f' : args->flags &= ~CLD_FLG_POISSON; leftovers++; break;
+						case 'p' : args->flags |= CLD_FLG_POISSON; leftovers++; break;
+						default : leftovers = optarg; break;
+					}
+				}
+				if((args->arrival_rate == 0) || (*leftovers != '\0')) {
+					pMsg(WARN, args, "-%c takes iops[:f|p].\n", c);
+					return(-1);
+				}
+				args->flags |= CLD_FLG_OPEN;
+				break;
+			case 'l' :
+				if(optarg == NULL) {
+					pMsg(WARN, args, "-%c option requires an argument.\n", c);
+					return(-1);
+				}
+				/* caps for reads, writes or all IO, then IOPS[:bandwidth] */
+				op = RATE_ALL;
+				p = optarg;
+				if(*p == 'r') {
+					op = READER;
+					p++;
+				} else if(*p == 'w') {
+					op = WRITER;
+					p++;
+				}
+				/* an empty IOPS field, as in -l r:10m, leaves IOPS uncapped */
+				if(*p != '\0') {
+					args->rate_cap[RATE_IOPS(op)] = parse_rate(p, &leftovers);
+					if(*leftovers == ':') {
+						p = leftovers + 1;
+						args->rate_cap[RATE_BW(op)] = parse_rate(p, &leftovers);
+					}
+				}
+				if((*p == '\0') || (leftovers == p) || (*leftovers != '\0')) {
+					pMsg(WARN, args, "-%c takes [r|w]iops[:bytes_per_sec].\n", c);
+					return(-1);
+				}
+				args->flags |= CLD_FLG_RATE;
+				break;
+			case 'O' :
+				if(optarg == NULL) {
+					pMsg(WARN, args, "-%c option requires an argument.\n", c);
+					return(-1);
+				}
+				if(((strncmp(optarg, "json:", 5) != 0) && (strncmp(optarg, "csv:", 4) != 0)) || (strchr(optarg, ':')[1] == '\0')) {
+					pMsg(WARN, args, "-%c takes json: or csv: followed by a file, - for stdout, or &fd.\n", c);
+					return(-1);
+				}
+				if(strlen(optarg) >= STAT_LOG_LEN) {
+					pMsg(WARN, args, "-%c stats record destination is too long.\n", c);
+					return(-1);
+				}
+				strncpy(args->stat_log, optarg, STAT_LOG_LEN-1);
+				break;
 			case 'R' : 
 				if(optarg == NULL) {
 					pMsg(WARN, args, "-%c option requires an argument.\n", c);
@@ -354,13 +494,18 @@ int fill_cld_args(int argc, char **argv, child_args_t *args)
 				if (strchr(optarg,'a')) {
 					args->flags |= CLD_FLG_MRK_ALL;
 				}
+				if (strchr(optarg,'c')) {
+					/* the CRC only proves an LBA is whole, the LBA and pass marks prove it is the right one */
+					args->flags |= (CLD_FLG_MRK_CRC|CLD_FLG_MRK_LBA|CLD_FLG_MRK_PASS);
+				}
 				if (!strchr(optarg,'l') &&
 						!strchr(optarg,'p') &&
 						!strchr(optarg,'t') &&
 						!strchr(optarg,'s') &&
 						!strchr(optarg,'h') &&
 						!strchr(optarg,'f') &&
-						!strchr(optarg,'a')) {
+						!strchr(optarg,'a') &&
+						!strchr(optarg,'c')) {
 					pMsg(WARN, args, "Unknown header mark option\n");
 					return(-1);
 				}
@@ -458,6 +603,45 @@ int fill_cld_args(int argc, char **argv, child_args_t *args)
 					}
 					args->flags |= CLD_FLG_WFSYNC;
 				}
+				if (strchr(optarg,'u')) {
+#ifdef LINUX
+					args->io_depth = strtoul((char *)strchr(optarg,'u')+1, NULL, 10);
+#ifdef _DEBUG
+					PDBG3(DBUG, args, "Parsed io_uring queue depth: %u\n", args->io_depth);
+#endif
+					args->flags |= CLD_FLG_URING;
+#else
+					pMsg(ERR, args, "io_uring IO is only supported on Linux\n");
+					return(-1);
+#endif
+				}
+				if (strchr(optarg,'a')) {
+#ifdef LINUX
+					if(args->flags & CLD_FLG_URING) {
+						pMsg(ERR, args, "Can only specify one async IO engine\n");
+						return(-1);
+					}
+					args->io_depth = strtoul((char *)strchr(optarg,'a')+1, NULL, 10);
+#ifdef _DEBUG
+					PDBG3(DBUG, args, "Parsed native aio queue depth: %u\n", args->io_depth);
+#endif
+					args->flags |= CLD_FLG_LIBAIO;
+#else
+					pMsg(ERR, args, "Native aio IO is only supported on Linux\n");
+					return(-1);
+#endif
+				}
+				if (strchr(optarg,'v')) {
+					args->flags |= CLD_FLG_VECTOR;
+				}
+				if (strchr(optarg,'h')) {
+#ifdef LINUX
+					args->flags |= CLD_FLG_ARENA;
+#else
+					pMsg(ERR, args, "Huge page IO buffers are only supported on Linux\n");
+					return(-1);
+#endif
+				}
 				break;
 			case 't' : 
 				if(optarg == NULL) {
@@ -834,6 +1018,20 @@ int make_assumptions(child_args_t *args)
 			args->flags |= CLD_FLG_R;
 		}
 	}
+	if((args->rand_len > 0) && !(args->flags & CLD_FLG_PTYPS)) {
+		strncat(args->argstr, "(-z) ", (MAX_ARG_LEN-1)-strlen(args->argstr));
+		args->flags |= CLD_FLG_RPTYPE;
+	}
+	if(args->rand_len == 0) {
+		args->rand_len = BLK_SIZE;
+	}
+	if(args->dedupe_ratio > 1) {
+		/* every ratio chunks of the tested range share the same data */
+		args->dedupe_chunks = (OFF_T) ((double) ((args->stop_lba - args->start_lba + 1) / DEDUPE_BLKS) / args->dedupe_ratio);
+		if(args->dedupe_chunks < 1) {
+			args->dedupe_chunks = 1;
+		}
+	}
 	if(!(args->flags & CLD_FLG_PTYPS)) {
 		strncat(args->argstr, "(-c) ", (MAX_ARG_LEN-1)-strlen(args->argstr));
 		args->flags |= CLD_FLG_CPTYPE;
@@ -869,6 +1067,18 @@ int make_assumptions(child_args_t *args)
 			args->flags |= CLD_FLG_LUNU;
 		}
 	}
+	/*
+	 * If every thread does the same operation, with the same transfer size,
+	 * in a fixed order, the next LBA is just a ticket taken from an atomic
+	 * counter.  Actions in flight can only overlap an action with the same
+	 * operation and data, so LBA locking is not needed either.
+	 */
+	if(((args->flags & CLD_FLG_SWEEP) ||
+		((args->flags & CLD_FLG_LINEAR) && !(args->flags & (CLD_FLG_NTRLVD|CLD_FLG_LUND)))) &&
+		!(args->flags & (CLD_FLG_RTRSIZ|CLD_FLG_WRITE_ONCE))) {
+		args->flags |= CLD_FLG_LBA_DISP;
+		args->flags &= ~CLD_FLG_LBA_SYNC;
+	}
 	normalize_percs(args);
 	if(!(args->flags & CLD_FLG_DUTY) && (args->flags & CLD_FLG_RANDOM) && !(args->flags & CLD_FLG_NTRLVD)) {
 		sprintf(TmpStr, "(-D %d:%d) ", args->rperc, args->wperc);
@@ -881,6 +1091,19 @@ int make_assumptions(child_args_t *args)
 	if(!(args->flags & CLD_FLG_OFFSET)) {
 		strncat(args->argstr, "(-o 0) ", (MAX_ARG_LEN-1)-strlen(args->argstr));
 	}
+	if(!(args->flags & CLD_FLG_ASYNC)) {
+		args->io_depth = 1;
+	} else if(args->io_depth == 0) {
+		if(args->flags & CLD_FLG_URING) {
+			sprintf(TmpStr, "(-I u%d) ", IO_DEPTH);
+			strncat(args->argstr, TmpStr, (MAX_ARG_LEN-1)-strlen(args->argstr));
+		}
+		if(args->flags & CLD_FLG_LIBAIO) {
+			sprintf(TmpStr, "(-I a%d) ", IO_DEPTH);
+			strncat(args->argstr, TmpStr, (MAX_ARG_LEN-1)-strlen(args->argstr));
+		}
+		args->io_depth = IO_DEPTH;
+	}
 
 	return(0);
 }
@@ -993,13 +1216,17 @@ int check_conclusions(child_args_t *args)
 		pMsg(ERR, args, "Heartbeat should be at least equal to runtime, use -h/-T to adjust.\n");
 		return(-1);
 	}
-	if((args->hbeat > 0) && !(args->flags & CLD_FLG_PRFTYPS)) {
-		pMsg(ERR, args, "At least one performance option, -P, must be specified when using -h.\n");
+	if((args->hbeat > 0) && !(args->flags & CLD_FLG_PRFTYPS) && (args->stat_log[0] == '\0')) {
+		pMsg(ERR, args, "At least one performance option, -P, or -O must be specified when using -h.\n");
 		return(-1);
 	}
 	if((args->flags & CLD_FLG_W) && !(args->flags & CLD_FLG_R) && (args->flags & CLD_FLG_CMPR)) {
 		pMsg(ERR, args, "Write only, ignoring option -E.\n");
 	}
+	if(((args->rand_len < BLK_SIZE) || (args->dedupe_ratio > 1)) && !(args->flags & CLD_FLG_RPTYPE)) {
+		pMsg(ERR, args, "Compression and dedupe ratios, -Z, can only be used with random data, -z.\n");
+		return(-1);
+	}
 	if((args->flags & CLD_FLG_TMD) && (args->flags & CLD_FLG_SKS)) {
 		pMsg(ERR, args, "Can't specify both -L and -T they are mutually exclusive.\n");
 		return(-1);
@@ -1032,5 +1259,25 @@ int check_conclusions(child_args_t *args)
 		pMsg(ERR, args, LBAOTSGSLBA, args->offset, args->ltrsiz, args->stop_lba);
 		return(-1);
 	}
+	if(args->io_depth > MAX_IO_DEPTH) {
+		pMsg(ERR, args, "Async IO queue depth, %u, exceeds max of %u.\n", args->io_depth, MAX_IO_DEPTH);
+		return(-1);
+	}
+	if((args->flags & CLD_FLG_LIBAIO) && !(args->flags & CLD_FLG_DIRECT)) {
+		pMsg(ERR, args, "Native aio IO, -Ia, requires Direct IO, -Id.\n");
+		return(-1);
+	}
+	if((args->flags & CLD_FLG_VECTOR) && (args->flags & CLD_FLG_DIRECT)) {
+		pMsg(ERR, args, "Can't specify vectored IO, -Iv, with Direct IO.\n");
+		return(-1);
+	}
+	if((args->flags & CLD_FLG_VECTOR) && (args->flags & CLD_FLG_ASYNC)) {
+		pMsg(ERR, args, "Can't specify vectored IO, -Iv, with async IO.\n");
+		return(-1);
+	}
+	if((args->flags & CLD_FLG_ASYNC) && (args->flags & CLD_FLG_IO_SERIAL)) {
+		pMsg(ERR, args, "Can't specify IO serialization, -AS, with async IO.\n");
+		return(-1);
+	}
 	return(0);
 }
@@ -0,0 +1,453 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+#include <string.h>
+
+#include "defs.h"
+#include "main.h"
+#include "sfunc.h"
+#include "pattern.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PATTERN_X86 1
+#include <immintrin.h>
+#endif
+
+#define BLK_WORDS (BLK_SIZE/sizeof(OFF_T))
+
+typedef struct pattern_ops {
+	void (*fill64)(void *, const size_t, const OFF_T);
+	void (*fill_lba)(void *, const size_t, const OFF_T);
+	void (*fill_count)(void *, const size_t);
+	size_t (*compare)(const void *, const void *, const size_t);
+	size_t (*count_diff)(const void *, const void *, const size_t);
+} pattern_ops_t;
+
+/*
+ * plain C versions
+ */
+void fill64_c(void *buf, const size_t words, const OFF_T pat)
+{
+	OFF_T *off_tbuf = buf;
+	size_t i;
+
+	for(i=0;i<words;i++) {
+		off_tbuf[i] = pat;
+	}
+}
+
+void fill_lba_c(void *buf, const size_t blocks, const OFF_T lba)
+{
+	size_t j;
+
+	for(j=0;j<blocks;j++) {
+		fill64_c((OFF_T *) buf + (j*BLK_WORDS), BLK_WORDS, WIRE64(lba+j));
+	}
+}
+
+void fill_count_c(void *buf, const size_t len)
+{
+	unsigned char *ucharbuf = buf;
+	size_t i;
+
+	for(i=0;i<len;i++) {
+		ucharbuf[i] = (unsigned char) (i & 0xff);
+	}
+}
+
+size_t compare_c(const void *a, const void *b, const size_t len)
+{
+	const unsigned char *pa = a, *pb = b;
+	size_t i;
+
+	for(i=0;i<len;i++) {
+		if(pa[i] != pb[i]) break;
+	}
+	return i;
+}
+
+size_t count_diff_c(const void *a, const void *b, const size_t len)
+{
+	const unsigned char *pa = a, *pb = b;
+	size_t i, n = 0;
+
+	for(i=0;i<len;i++) {
+		if(pa[i] != pb[i]) n++;
+	}
+	return n;
+}
+
+/*
+ * CRC32C, the Castagnoli polynomial, with slice by 8 tables
+ * made by PatternInit, for cpus without the SSE4.2 crc32 instruction
+ */
+#define CRC32C_POLY 0x82F63B78
+
+unsigned int crc32c_table[8][256];
+
+void crc32c_init(void)
+{
+	unsigned int i, j, crc;
+
+	for(i=0;i<256;i++) {
+		crc = i;
+		for(j=0;j<8;j++) {
+			crc = (crc & 1) ? ((crc >> 1) ^ CRC32C_POLY) : (crc >> 1);
+		}
+		crc32c_table[0][i] = crc;
+	}
+	for(i=0;i<256;i++) {
+		for(j=1;j<8;j++) {
+			crc32c_table[j][i] = (crc32c_table[j-1][i] >> 8) ^ crc32c_table[0][crc32c_table[j-1][i] & 0xff];
+		}
+	}
+}
+
+unsigned int crc32c_c(unsigned int crc, const void *buf, const size_t len)
+{
+	const unsigned char *p = buf;
+	size_t i = 0;
+	unsigned int lo, hi;
+
+	crc = ~crc;
+	for(;i+8<=len;i+=8) {
+		lo = crc ^ ((unsigned int) p[i] | ((unsigned int) p[i+1] << 8) | ((unsigned int) p[i+2] << 16) | ((unsigned int) p[i+3] << 24));
+		hi = (unsigned int) p[i+4] | ((unsigned int) p[i+5] << 8) | ((unsigned int) p[i+6] << 16) | ((unsigned int) p[i+7] << 24);
+		crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+			  crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+			  crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+			  crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+	}
+	for(;i<len;i++) {
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ p[i]) & 0xff];
+	}
+	return ~crc;
+}
+
+#ifdef PATTERN_X86
+#ifdef __x86_64__
+__attribute__((target("sse4.2")))
+unsigned int crc32c_sse42(unsigned int crc, const void *buf, const size_t len)
+{
+	const unsigned char *p = buf;
+	unsigned long long c = ~crc & 0xffffffffULL, v;
+	size_t i = 0;
+
+	for(;i+8<=len;i+=8) {
+		memcpy(&v, p+i, sizeof(v));
+		c = _mm_crc32_u64(c, v);
+	}
+	for(;i<len;i++) {
+		c = _mm_crc32_u8((unsigned int) c, p[i]);
+	}
+	return ~(unsigned int) c;
+}
+#endif
+
+/*
+ * SSE2 versions, a block is 32 16 byte stores
+ */
+__attribute__((target("sse2")))
+void fill64_sse2(void *buf, const size_t words, const OFF_T pat)
+{
+	__m128i v = _mm_set1_epi64x((long long) pat);
+	__m128i *p = buf;
+	size_t i;
+
+	for(i=0;i+2<=words;i+=2) {
+		_mm_storeu_si128(p++, v);
+	}
+	if(i < words) {
+		((OFF_T *) buf)[i] = pat;
+	}
+}
+
+__attribute__((target("sse2")))
+void fill_lba_sse2(void *buf, const size_t blocks, const OFF_T lba)
+{
+	__m128i v, *p = buf;
+	size_t i, j;
+
+	for(j=0;j<blocks;j++) {
+		v = _mm_set1_epi64x((long long) WIRE64(lba+j));
+		for(i=0;i<BLK_SIZE/sizeof(__m128i);i++) {
+			_mm_storeu_si128(p++, v);
+		}
+	}
+}
+
+__attribute__((target("sse2")))
+void fill_count_sse2(void *buf, const size_t len)
+{
+	__m128i v = _mm_setr_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+	__m128i step = _mm_set1_epi8(16);
+	__m128i *p = buf;
+	size_t i;
+
+	/* byte adds wrap at 0xff, just like the count does */
+	for(i=0;i+sizeof(__m128i)<=len;i+=sizeof(__m128i)) {
+		_mm_storeu_si128(p++, v);
+		v = _mm_add_epi8(v, step);
+	}
+	for(;i<len;i++) {
+		((unsigned char *) buf)[i] = (unsigned char) (i & 0xff);
+	}
+}
+
+/* each bit of the mask is set for a byte that differs */
+__attribute__((target("sse2")))
+size_t compare_sse2(const void *a, const void *b, const size_t len)
+{
+	const unsigned char *pa = a, *pb = b;
+	unsigned int m;
+	size_t i;
+
+	for(i=0;i+sizeof(__m128i)<=len;i+=sizeof(__m128i)) {
+		m = 0xffff ^ (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *) (pa+i)), _mm_loadu_si128((const __m128i *) (pb+i))));
+		if(m != 0) return i + __builtin_ctz(m);
+	}
+	return i + compare_c(pa+i, pb+i, len-i);
+}
+
+__attribute__((target("sse2")))
+size_t count_diff_sse2(const void *a, const void *b, const size_t len)
+{
+	const unsigned char *pa = a, *pb = b;
+	unsigned int m;
+	size_t i, n = 0;
+
+	for(i=0;i+sizeof(__m128i)<=len;i+=sizeof(__m128i)) {
+		m = 0xffff ^ (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *) (pa+i)), _mm_loadu_si128((const __m128i *) (pb+i))));
+		n += __builtin_popcount(m);
+	}
+	return n + count_diff_c(pa+i, pb+i, len-i);
+}
+
+/*
+ * AVX2 versions, a block is 16 32 byte stores
+ */
+__attribute__((target("avx2")))
+void fill64_avx2(void *buf, const size_t words, const OFF_T pat)
+{
+	__m256i v = _mm256_set1_epi64x((long long) pat);
+	__m256i *p = buf;
+	size_t i;
+
+	for(i=0;i+4<=words;i+=4) {
+		_mm256_storeu_si256(p++, v);
+	}
+	for(;i<words;i++) {
+		((OFF_T *) buf)[i] = pat;
+	}
+}
+
+__attribute__((target("avx2")))
+void fill_lba_avx2(void *buf, const size_t blocks, const OFF_T lba)
+{
+	__m256i v, *p = buf;
+	size_t i, j;
+
+	for(j=0;j<blocks;j++) {
+		v = _mm256_set1_epi64x((long long) WIRE64(lba+j));
+		for(i=0;i<BLK_SIZE/sizeof(__m256i);i++) {
+			_mm256_storeu_si256(p++, v);
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+void fill_count_avx2(void *buf, const size_t len)
+{
+	__m256i v = _mm256_setr_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,
+		16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31);
+	__m256i step = _mm256_set1_epi8(32);
+	__m256i *p = buf;
+	size_t i;
+
+	for(i=0;i+sizeof(__m256i)<=len;i+=sizeof(__m256i)) {
+		_mm256_storeu_si256(p++, v);
+		v = _mm256_add_epi8(v, step);
+	}
+	for(;i<len;i++) {
+		((unsigned char *) buf)[i] = (unsigned char) (i & 0xff);
+	}
+}
+__attribute__((target("avx2")))
+size_t compare_avx2(const void *a, const void *b, const size_t len)
+{
+	const unsigned char *pa = a, *pb = b;
+	unsigned int m;
+	size_t i;
+
+	for(i=0;i+sizeof(__m256i)<=len;i+=sizeof(__m256i)) {
+		m = ~(unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *) (pa+i)), _mm256_loadu_si256((const __m256i *) (pb+i))));
+		if(m != 0) return i + __builtin_ctz(m);
+	}
+	return i + compare_c(pa+i, pb+i, len-i);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t count_diff_avx2(const void *a, const void *b, const size_t len)
+{
+	const unsigned char *pa = a, *pb = b;
+	unsigned int m;
+	size_t i, n = 0;
+
+	for(i=0;i+sizeof(__m256i)<=len;i+=sizeof(__m256i)) {
+		m = ~(unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *) (pa+i)), _mm256_loadu_si256((const __m256i *) (pb+i))));
+		n += __builtin_popcount(m);
+	}
+	return n + count_diff_c(pa+i, pb+i, len-i);
+}
+#endif /* PATTERN_X86 */
+
+const pattern_ops_t pattern_c = { fill64_c, fill_lba_c, fill_count_c, compare_c, count_diff_c };
+#ifdef PATTERN_X86
+const pattern_ops_t pattern_sse2 = { fill64_sse2, fill_lba_sse2, fill_count_sse2, compare_sse2, count_diff_sse2 };
+const pattern_ops_t pattern_avx2 = { fill64_avx2, fill_lba_avx2, fill_count_avx2, compare_avx2, count_diff_avx2 };
+#endif
+
+const pattern_ops_t *pattern_ops = &pattern_c;
+unsigned int (*pattern_crc32c)(unsigned int, const void *, const size_t) = crc32c_c;
+
+void PatternInit(void)
+{
+	crc32c_init();
+#ifdef PATTERN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		pattern_ops = &pattern_avx2;
+	} else if(__builtin_cpu_supports("sse2")) {
+		pattern_ops = &pattern_sse2;
+	}
+#ifdef __x86_64__
+	if(__builtin_cpu_supports("sse4.2")) {
+		pattern_crc32c = crc32c_sse42;
+	}
+#endif
+#endif
+}
+
+/*
+ * splitmix64 output function, used to make
+ * counter based random data
+ */
+unsigned long long mix64(unsigned long long z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/*
+ * fills blocks LBAs of buf with random data, starting at lba.  Each LBA
+ * gets its own data, made from key and its LBA number alone, so any
+ * block can be made again to compare it, without the data being kept.
+ * Only the first rand_len bytes of an LBA are random, the rest are zero.
+ * When chunks is not 0, the LBAs from first on are treated as chunks of
+ * DEDUPE_BLKS LBAs, with every chunks'th chunk holding the same data.
+ * There is no vector version, as 64 bit multiplies need AVX-512.
+ */
+void PatternFillRandom(void *buf, const size_t blocks, const OFF_T key, const OFF_T lba, const size_t rand_len, const OFF_T first, const OFF_T chunks)
+{
+	OFF_T *off_tbuf = buf;
+	OFF_T blk, off;
+	unsigned long long x;
+	size_t i, j, words = rand_len/sizeof(OFF_T);
+
+	for(j=0;j<blocks;j++) {
+		blk = lba+j;
+		if((chunks > 0) && (blk >= first)) {
+			off = blk - first;
+			blk = first + ((off / DEDUPE_BLKS) % chunks) * DEDUPE_BLKS + (off % DEDUPE_BLKS);
+		}
+		x = mix64((unsigned long long) key ^ ((unsigned long long) blk * 0xD1B54A32D192ED03ULL));
+		for(i=0;i<words;i++) {
+			x += 0x9E3779B97F4A7C15ULL;
+			off_tbuf[i] = WIRE64(mix64(x));
+		}
+		for(;i<BLK_WORDS;i++) {
+			off_tbuf[i] = 0;
+		}
+		off_tbuf += BLK_WORDS;
+	}
+}
+
+/*
+ * fills words 64 bit words of buf with pat
+ */
+void PatternFill64(void *buf, const size_t words, const OFF_T pat)
+{
+	pattern_ops->fill64(buf, words, pat);
+}
+
+/*
+ * fills blocks LBAs of buf, each with its own LBA number, starting at lba
+ */
+void PatternFillLBA(void *buf, const size_t blocks, const OFF_T lba)
+{
+	pattern_ops->fill_lba(buf, blocks, lba);
+}
+
+/*
+ * fills len bytes of buf with a count from 0x00 thru 0xff
+ */
+void PatternFillCount(void *buf, const size_t len)
+{
+	pattern_ops->fill_count(buf, len);
+}
+
+/*
+ * returns the offset of the first byte that differs
+ * between a and b, or len if they are the same
+ */
+size_t PatternCompare(const void *a, const void *b, const size_t len)
+{
+	return pattern_ops->compare(a, b, len);
+}
+
+/*
+ * returns the number of bytes that differ between a and b
+ */
+size_t PatternCountDiff(const void *a, const void *b, const size_t len)
+{
+	return pattern_ops->count_diff(a, b, len);
+}
+
+/*
+ * returns the CRC32C of len bytes of buf, continuing
+ * from crc, which is 0 for the start of the data
+ */
+unsigned int PatternCRC32C(unsigned int crc, const void *buf, const size_t len)
+{
+	return pattern_crc32c(crc, buf, len);
+}
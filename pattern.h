@@ -0,0 +1,47 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+#ifndef _PATTERN_H
+#define _PATTERN_H 1
+
+#include "defs.h"
+
+/*
+ * Data pattern fill and compare kernels.  PatternInit picks the widest
+ * version the cpu can run, SSE2 or AVX2 on x86, or plain C everywhere else.
+ */
+void PatternInit(void);
+void PatternFill64(void *, const size_t, const OFF_T);
+void PatternFillLBA(void *, const size_t, const OFF_T);
+void PatternFillCount(void *, const size_t);
+void PatternFillRandom(void *, const size_t, const OFF_T, const OFF_T, const size_t, const OFF_T, const OFF_T);
+size_t PatternCompare(const void *, const void *, const size_t);
+size_t PatternCountDiff(const void *, const void *, const size_t);
+unsigned int PatternCRC32C(unsigned int, const void *, const size_t);
+
+#endif /* _PATTERN_H */
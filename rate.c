@@ -0,0 +1,88 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifdef WINDOWS
+#include <windows.h>
+#endif
+
+#include "defs.h"
+#include "main.h"
+#include "threading.h"
+#include "timer.h"
+#include "rate.h"
+
+/*
+ * How far a bucket may fall behind and still catch up, in nsecs.  This
+ * covers late wakeups and short stalls of the paced threads, without
+ * letting an idle target burst much past its cap.
+ */
+#define RATE_BURST		5000000
+
+/*
+ * sets up the bucket for per_sec IOs or bytes a second, 0 for no cap
+ */
+void RateInit(rate_t *rate, const OFF_T per_sec)
+{
+	rate->tat = 0;
+	rate->cost = (per_sec > 0) ? (double) NSECS_PER_SEC / (double) per_sec : 0;
+}
+
+/*
+ * Takes the tokens for count IOs or bytes at now, and returns the
+ * time, nsecs from getMonoTime, the IO may be issued at.
+ */
+OFF_T RateTake(rate_t *rate, const OFF_T count, const OFF_T now)
+{
+	OFF_T tat, start, cost;
+
+	if(rate->cost == 0) return 0;
+	cost = (OFF_T) (rate->cost * (double) count);
+	do {
+		tat = rate->tat;
+		start = (tat < now - RATE_BURST) ? now - RATE_BURST : tat;
+	} while(!ATOMIC_CAS(&rate->tat, tat, start + cost));
+	return start;
+}
+
+/*
+ * Takes the next arrival from a schedule at the rate's pace, the first
+ * one being now.  gap is the space to the arrival after it, as a
+ * multiple of the mean.  Arrivals are never dropped, so those missed
+ * while the target stalls are issued late, rather than not at all.
+ */
+OFF_T RateArrival(rate_t *rate, const double gap, const OFF_T now)
+{
+	OFF_T tat, start;
+
+	do {
+		tat = rate->tat;
+		start = (tat == 0) ? now : tat;
+	} while(!ATOMIC_CAS(&rate->tat, tat, start + (OFF_T) (rate->cost * gap)));
+	return start;
+}
@@ -0,0 +1,45 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifndef _RATE_H
+#define _RATE_H 1
+
+#include "defs.h"
+#include "main.h"
+
+/*
+ * Token buckets that hold IO to an IOPS or bandwidth cap.  RateTake
+ * spends tokens for an IO and returns when it may be issued, so the
+ * caller paces itself rather than spinning on the bucket.
+ */
+void RateInit(rate_t *, const OFF_T);
+OFF_T RateTake(rate_t *, const OFF_T, const OFF_T);
+OFF_T RateArrival(rate_t *, const double, const OFF_T);
+
+#endif /* _RATE_H */
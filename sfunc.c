@@ -59,6 +59,7 @@
 #include "globals.h"
 #include "io.h"
 #include "threading.h"
+#include "pattern.h"
 
 /*
  * Generates a random 32bit number.
@@ -94,6 +95,63 @@ OFF_T Rand64(void)
 	return(myRandomNumber);
 }
 
+/*
+ * Per thread random number generator, xoshiro256**.  Each thread
+ * keeps its own state, so threads do not share the lock inside of
+ * rand().  The state is seeded with splitmix64 from seed and stream,
+ * so different streams from the same seed do not overlap.
+ */
+void RandSeed(rand_state_t *state, const unsigned long long seed, const unsigned long long stream)
+{
+	unsigned long long z, x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+	int i;
+
+	for(i = 0; i < 4; i++) {
+		x += 0x9E3779B97F4A7C15ULL;
+		z = x;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		state->s[i] = z ^ (z >> 31);
+	}
+}
+
+#define ROTL64(x, k) (((x) << (k)) | ((x) >> (64 - (k))))
+
+unsigned long long RandNext(rand_state_t *state)
+{
+	unsigned long long *s = state->s;
+	unsigned long long result = ROTL64(s[1] * 5, 7) * 9;
+	unsigned long long t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = ROTL64(s[3], 45);
+
+	return(result);
+}
+
+/*
+ * Returns a random number from 0 to range-1, without the bias
+ * of a plain modulo.  Values below threshold, the remainder of
+ * 2^64 divided by range, are thrown away, which is rare unless
+ * range is close to 2^64.
+ */
+unsigned long long RandRange(rand_state_t *state, const unsigned long long range)
+{
+	unsigned long long r, threshold;
+
+	if(range <= 1) { return(0); }
+	threshold = (0 - range) % range;
+	do {
+		r = RandNext(state);
+	} while(r < threshold);
+
+	return(r % range);
+}
+
 /*
 * could not find a function that represented a conversion
 * between a long long and a string.
@@ -150,7 +208,7 @@ OFF_T my_strtofft(const char *pStr)
 /*
 * prints messages to stdout. with added formating
 */
-int pMsg(lvl_t level, const child_args_t *args, char *Msg,...)
+int pMsg(lvl_t level, const child_args_t *args, const char *Msg,...)
 {
 #define FORMAT "| %s | %s | %d | %s | %s | %s"
 #define TIME_FORMAT "%04d/%02d/%02d-%02d:%02d:%02d"
@@ -255,37 +313,61 @@ int pMsg(lvl_t level, const child_args_t *args, char *Msg,...)
 
 OFF_T getByteOrderedData(const OFF_T data)
 {
-	OFF_T off_tpat = 0;
+	return WIRE64(data);
+}
 
-#ifdef WINDOWS
-	unsigned char *ucharpattern;
-	size_t i = 0;
+/*
+ * returns the CRC32C of the LBA at blk, leaving out
+ * the bytes the CRC itself is stored in
+ */
+unsigned int mark_crc(const unsigned char *blk)
+{
+	unsigned int crc;
 
-	ucharpattern = (unsigned char *) &data;
-	for(i=0;i<sizeof(OFF_T);i++) {
-		off_tpat |= (((OFF_T)(ucharpattern[i])) << sizeof(OFF_T)*((sizeof(OFF_T)-1)-i));
-	}
-#endif
+	crc = PatternCRC32C(0, blk, MARK_CRC_OFF);
+	return PatternCRC32C(crc, blk+MARK_CRC_OFF+sizeof(OFF_T), BLK_SIZE-MARK_CRC_OFF-sizeof(OFF_T));
+}
 
-#ifdef AIX
-	off_tpat = data;
-#endif
+/*
+ * returns TRUE if the CRC32C stored in the mark
+ * of the LBA at blk matches its data
+ */
+BOOL mark_crc_valid(const unsigned char *blk)
+{
+	OFF_T stored;
 
-#ifdef LINUX
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-	unsigned char *ucharpattern;
-	size_t i = 0;
+	memcpy(&stored, blk+MARK_CRC_OFF, sizeof(OFF_T));
+	return (getByteOrderedData(stored) == (OFF_T) mark_crc(blk)) ? TRUE : FALSE;
+}
 
-	ucharpattern = (unsigned char *) &data;
-	for(i=0;i<sizeof(OFF_T);i++) {
-		off_tpat |= (((OFF_T)(ucharpattern[i])) << sizeof(OFF_T)*((sizeof(OFF_T)-1)-i));
+/*
+ * returns the number of bytes at the start of each LBA
+ * that mark_buffer will write, based on the -m flags
+ */
+size_t mark_length(const child_args_t *args)
+{
+	if(!(args->flags & CLD_FLG_MBLK)) {
+		return 0;
 	}
-#else
-	off_tpat = data;
-#endif
-#endif
-
-	return off_tpat;
+	if(args->flags & CLD_FLG_MRK_TARGET) {
+		return 32+HOSTNAME_SIZE+strlen(args->device);
+	}
+	if(args->flags & CLD_FLG_MRK_HOST) {
+		return 32+HOSTNAME_SIZE;
+	}
+	if(args->flags & CLD_FLG_MRK_SEED) {
+		return 32;
+	}
+	if(args->flags & CLD_FLG_MRK_TIME) {
+		return 24;
+	}
+	if(args->flags & CLD_FLG_MRK_PASS) {
+		return 16;
+	}
+	if(args->flags & CLD_FLG_MRK_LBA) {
+		return 8;
+	}
+	return 0;
 }
 
 void mark_buffer(void *buf, const size_t buf_len, void *lba, const child_args_t *args, const test_env_t *env)
@@ -293,46 +375,52 @@ void mark_buffer(void *buf, const size_t buf_len, void *lba, const child_args_t
 	OFF_T *plocal_lba = lba;
 	OFF_T local_lba = *plocal_lba;
 	OFF_T *off_tbuf = buf;
-	OFF_T off_tpat = 0, off_tpat2 = 0, off_tpat3 = 0, off_tpat4 = 0;
-	OFF_T pass_count = env->pass_count;
-	OFF_T start_time = (OFF_T)env->start_time;
 	unsigned char * ucharBuf = (unsigned char *)buf;
-	size_t i = 0;
+	OFF_T hdr[MARK_HDR_SIZE/sizeof(OFF_T)];
+	unsigned char *ucharHdr = (unsigned char *)hdr;
+	size_t dev_len = strlen(args->device);
+	const unsigned long long fld_flag[5] = { CLD_FLG_MRK_PASS, CLD_FLG_MRK_TIME, CLD_FLG_MRK_SEED, CLD_FLG_MRK_HOST, CLD_FLG_MRK_TARGET };
+	const size_t fld_off[5] = { 8, 16, 24, 32, 32+HOSTNAME_SIZE };
+	size_t fld_len[5] = { 8, 8, 8, HOSTNAME_SIZE, 0 };
+	size_t run_off[5], run_len[5], nruns = 0;
+	size_t i = 0, f;
 	extern char hostname[];
 
-	off_tpat2 = getByteOrderedData(pass_count);
+	/*
+	 * the marks, other then the LBA, are the same for every LBA, so they
+	 * are built once, and copied to each LBA as runs of adjacent fields
+	 */
+	fld_len[4] = dev_len;
+	hdr[1] = WIRE64(env->pass_count);
 	if(args->flags & CLD_FLG_ALT_MARK) {
-		off_tpat3 = getByteOrderedData(args->alt_mark);
+		hdr[2] = WIRE64(args->alt_mark);
 	} else {
-		off_tpat3 = getByteOrderedData(start_time);
+		hdr[2] = WIRE64((OFF_T)env->start_time);
+	}
+	hdr[3] = WIRE64(args->seed);
+	memcpy(ucharHdr+32, hostname, HOSTNAME_SIZE);
+	memcpy(ucharHdr+32+HOSTNAME_SIZE, args->device, dev_len);
+	for(f=0;f<5;f++) {
+		if(!(args->flags & fld_flag[f])) continue;
+		if((nruns > 0) && ((run_off[nruns-1]+run_len[nruns-1]) == fld_off[f])) {
+			run_len[nruns-1] += fld_len[f];
+		} else {
+			run_off[nruns] = fld_off[f];
+			run_len[nruns++] = fld_len[f];
+		}
 	}
-	off_tpat4 = getByteOrderedData(args->seed);
 
 	for(i=0;i<buf_len;i=i+BLK_SIZE) {
 		if(args->flags & CLD_FLG_MRK_LBA) {
 			/* fill first 8 bytes with lba number */
-			off_tpat = getByteOrderedData(local_lba);
-			*(off_tbuf+(i/sizeof(OFF_T))) = off_tpat;
-		}
-		if(args->flags & CLD_FLG_MRK_PASS) {
-			/* fill second 8 bytes with pass_count */
-			*(off_tbuf+(i/sizeof(OFF_T))+1) = off_tpat2;
-		}
-		if(args->flags & CLD_FLG_MRK_TIME) {
-			/* fill third 8 bytes with start_time */
-			*(off_tbuf+(i/sizeof(OFF_T))+2) = off_tpat3;
+			*(off_tbuf+(i/sizeof(OFF_T))) = WIRE64(local_lba);
 		}
-		if(args->flags & CLD_FLG_MRK_SEED) {
-			/* fill fourth 8 bytes with seed data */
-			*(off_tbuf+(i/sizeof(OFF_T))+3) = off_tpat4;
+		for(f=0;f<nruns;f++) {
+			memcpy(ucharBuf+i+run_off[f], ucharHdr+run_off[f], run_len[f]);
 		}
-		if(args->flags & CLD_FLG_MRK_HOST) {
-			/* now add the hostname to the mark data */
-			memcpy(ucharBuf+32+i, hostname, HOSTNAME_SIZE);
-		}
-		if(args->flags & CLD_FLG_MRK_TARGET) {
-			/* now add the target to the mark data */
-			memcpy(ucharBuf+32+HOSTNAME_SIZE+i, args->device, strlen(args->device));
+		if((args->flags & CLD_FLG_MRK_CRC) && ((i+BLK_SIZE) <= buf_len)) {
+			/* last, add the CRC32C of the whole LBA, so it covers the other marks */
+			*(off_tbuf+((i+MARK_CRC_OFF)/sizeof(OFF_T))) = WIRE64(mark_crc(ucharBuf+i));
 		}
 
 		local_lba++;
@@ -348,82 +436,29 @@ void mark_buffer(void *buf, const size_t buf_len, void *lba, const child_args_t
 
 void fill_buffer(void *buf, size_t len, void *pattern, size_t pattern_len, const unsigned int pattern_type)
 {
-	size_t i, j;
-	unsigned char *ucharbuf = buf;
-	OFF_T *off_tbuf = buf;
-	unsigned char *ucharpattern = pattern;
+	size_t j;
 	OFF_T *poff_tpattern = pattern;
-	OFF_T off_tpat, off_tpat2;
+	unsigned long long off_tpat, mask;
 
 	switch (pattern_type) { /* the pattern type should only be one of the following */
 		case CLD_FLG_CPTYPE :
 			/* Will fill buffer with counting pattern 0x00 thru 0xff */
-			for(i=0;i<len;i++)
-				ucharbuf[i] = (unsigned char) (i & 0xff);
+			PatternFillCount(buf, len);
 			break;
 		case CLD_FLG_FPTYPE :
-			/* arrange data to go on the wire correctly */
+			/* repeat the pattern through 64 bits, then arrange it to go on the wire correctly */
+			mask = (pattern_len < sizeof(OFF_T)) ? ((1ULL << (8*pattern_len)) - 1) : ~0ULL;
 			off_tpat = 0;
-			for(j=0;j<(sizeof(OFF_T)/pattern_len);j++)
-				for(i=0;i<pattern_len;++i)
-#ifdef WINDOWS
-					off_tpat |= (((OFF_T)(ucharpattern[i])) << 8*(7-((j*pattern_len)+i)));
-#endif
-#ifdef AIX
-					off_tpat |= (((OFF_T)(ucharpattern[(8-pattern_len)+i])) << 8*(7-((j*pattern_len)+i)));
-#endif
-#ifdef LINUX
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-					off_tpat |= (((OFF_T)(ucharpattern[i])) << 8*(7-((j*pattern_len)+i)));
-#else
-					off_tpat |= (((OFF_T)(ucharpattern[(8-pattern_len)+i])) << 8*(7-((j*pattern_len)+i)));
-#endif
-#endif
+			for(j=0;j<(sizeof(OFF_T)/pattern_len);j++) {
+				off_tpat |= ((unsigned long long) *poff_tpattern & mask) << (8*pattern_len*j);
+			}
 
 			/* fill buffer with fixed pattern */
-			for(i=0;i<len/8;i++)
-				*(off_tbuf+i) = off_tpat;
+			PatternFill64(buf, len/8, WIRE64(off_tpat));
 			break;
 		case CLD_FLG_LPTYPE :
-			off_tpat2 = *poff_tpattern;
-			for(j=0;j<len;j++) {
-				/* arrange data to go on the wire correctly */
-				ucharpattern = (unsigned char *) &off_tpat2;
-				off_tpat = 0;
-				for(i=0;i<pattern_len;i++)
-#ifdef WINDOWS
-					off_tpat |= (((OFF_T)(ucharpattern[i])) << 8*(7-i));
-#endif
-#ifdef AIX
-					off_tpat |= (((OFF_T)(ucharpattern[(8-pattern_len)+i])) << 8*(7-i));
-#endif
-#ifdef LINUX
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-					off_tpat |= (((OFF_T)(ucharpattern[i])) << 8*(7-i));
-#else
-					off_tpat |= (((OFF_T)(ucharpattern[(8-pattern_len)+i])) << 8*(7-i));
-#endif
-#endif
-
-				/* fill buffer with lba number */
-				for(i=0;i<BLK_SIZE/8;i++) {
-					*(off_tbuf+i+(j*(BLK_SIZE/8))) = off_tpat;
-				}
-				off_tpat2++;
-			}
-			break;
-		case CLD_FLG_RPTYPE :
-			/* Will fill buffer with a random pattern.
-			 * Unfortunatly, every LBA, 512 bytes of data will be
-			 * the same random data set, this is due to the LBA
-			 * boundary requirement of disktest.  This should be fixed
-			 * at some point...
-			 */
-			for(i=0;i<BLK_SIZE/sizeof(OFF_T);i++)
-				*(off_tbuf+i) = Rand64();
-
-			for(i=BLK_SIZE;i<len;i+=BLK_SIZE)
-				memcpy((ucharbuf+i), ucharbuf, BLK_SIZE);
+			/* fill buffer with lba number, len is in LBAs */
+			PatternFillLBA(buf, len, *poff_tpattern);
 			break;
 		default :
 			printf("Unknown fill pattern\n");
@@ -114,10 +114,37 @@ typedef struct fmt_time {
 	time_t seconds;
 } fmt_time_t;
 
+typedef struct rand_state {
+	unsigned long long s[4];
+} rand_state_t;
+
+/*
+ * converts a 64 bit value to, or from, the order it is kept in
+ * on the target, most significant byte first, on any host
+ */
+#ifdef LINUX
+#include <endian.h>
+#endif
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define WIRE64(x) ((OFF_T) __builtin_bswap64((unsigned long long) (x)))
+#elif defined(WINDOWS)
+#include <stdlib.h>
+#define WIRE64(x) ((OFF_T) _byteswap_uint64((unsigned __int64) (x)))
+#elif defined(LINUX) && (__BYTE_ORDER == __LITTLE_ENDIAN)
+#include <byteswap.h>
+#define WIRE64(x) ((OFF_T) bswap_64((unsigned long long) (x)))
+#else
+#define WIRE64(x) ((OFF_T) (x))
+#endif
+
 OFF_T my_strtofft(const char *pStr);
-int pMsg(lvl_t level, const child_args_t *, char *Msg,...);
+OFF_T getByteOrderedData(const OFF_T);
+int pMsg(lvl_t level, const child_args_t *, const char *Msg,...);
 void fill_buffer(void *, size_t, void *, size_t, const unsigned int);
 void mark_buffer(void *, const size_t, void *, const child_args_t *, const test_env_t *);
+size_t mark_length(const child_args_t *);
+unsigned int mark_crc(const unsigned char *);
+BOOL mark_crc_valid(const unsigned char *);
 void normalize_percs(child_args_t *);
 #ifndef WINDOWS
 void Sleep(unsigned int);
@@ -127,6 +154,9 @@ char *strlwr(char *);
 OFF_T get_vsiz(const char *);
 OFF_T get_file_size(char *);
 OFF_T Rand64(void);
+void RandSeed(rand_state_t *, const unsigned long long, const unsigned long long);
+unsigned long long RandNext(rand_state_t *);
+unsigned long long RandRange(rand_state_t *, const unsigned long long);
 fmt_time_t format_time(time_t);
 
 #endif /* _SFUNC_H */
@@ -0,0 +1,328 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifdef WINDOWS
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#include "defs.h"
+#include "main.h"
+#include "threading.h"
+#include "statlog.h"
+
+#define STAT_LOG_QUEUE	1024	/* records held for the writer, before new ones are dropped */
+#define STAT_LINE_LEN	2048	/* max characters in a record */
+
+#ifdef WINDOWS
+#define OFFSTR "%I64d"
+#define fdopen _fdopen
+#else
+#define OFFSTR "%lld"
+#endif
+
+typedef struct stat_node {
+	struct stat_node *next;
+	stat_record_t rec;
+} stat_node_t;
+
+static FILE *fpLog = NULL;
+static BOOL bCSV = FALSE;
+static hThread_t hWriter;
+static stat_node_t *head = NULL, *tail = NULL;
+static unsigned int queued = 0;
+static unsigned long dropped = 0;
+#ifdef WINDOWS
+static HANDLE MutexLOG = NULL;
+static HANDLE SemLOG = NULL;
+#else
+static pthread_mutex_t MutexLOG = PTHREAD_MUTEX_INITIALIZER;
+static sem_t SemLOG;
+#endif
+
+static const char *type_name[] = { "hbeat", "cycle", "total" };
+static const char *lat_name[STAT_LAT_VALS] = { "min", "mean", "p50", "p99", "p99.9", "p99.99", "max" };
+static const char oper_name[2] = { 'w', 'r' };	/* indexed by WRITER and READER */
+
+/*
+ * appends to the record being built in line
+ */
+static void put(char *line, size_t *len, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if(*len >= STAT_LINE_LEN) return;
+	va_start(ap, fmt);
+	n = vsnprintf(line + *len, STAT_LINE_LEN - *len, fmt, ap);
+	va_end(ap);
+	if(n > 0) *len += n;
+}
+
+static void write_csv_header(void)
+{
+	char line[STAT_LINE_LEN];
+	size_t len = 0;
+	int op, i;
+
+	put(line, &len, "type,time,elapsed,target,pass,depth,inflight,retries");
+	for(op = READER; op >= WRITER; op--) {
+		put(line, &len, ",%c_secs,%c_bytes,%c_xfers,%c_bps,%c_iops,%c_errors", oper_name[op], oper_name[op], oper_name[op], oper_name[op], oper_name[op], oper_name[op]);
+		for(i = 0; i < STAT_LAT_VALS; i++) {
+			put(line, &len, ",%c_lat_%s", oper_name[op], lat_name[i]);
+		}
+	}
+	put(line, &len, "\n");
+	fputs(line, fpLog);
+	fflush(fpLog);
+}
+
+/*
+ * appends the target name as a JSON or CSV string
+ */
+static void put_name(char *line, size_t *len, const char *name)
+{
+	const char *p;
+
+	put(line, len, "\"");
+	for(p = name; *p; p++) {
+		if(bCSV) {
+			put(line, len, (*p == '"') ? "\"\"" : "%c", *p);
+		} else if((*p == '"') || (*p == '\\')) {
+			put(line, len, "\\%c", *p);
+		} else if((unsigned char) *p < 0x20) {
+			put(line, len, "\\u%04x", (unsigned int) *p);
+		} else {
+			put(line, len, "%c", *p);
+		}
+	}
+	put(line, len, "\"");
+}
+
+/*
+ * Builds the whole record before writing it, so it goes out in one
+ * piece when it shares stdout with the messages.
+ */
+static void write_record(const stat_record_t *rec)
+{
+	char line[STAT_LINE_LEN];
+	size_t len = 0;
+	const stat_oper_t *o;
+	double secs;
+	int op, i;
+
+	if(bCSV) {
+		put(line, &len, "%s,%lu,%.3f,", type_name[rec->type], (unsigned long) rec->time, rec->elapsed);
+		put_name(line, &len, rec->device);
+		put(line, &len, "," OFFSTR ",%u,%u," OFFSTR, rec->pass, rec->depth, rec->inflight, rec->retries);
+	} else {
+		put(line, &len, "{\"type\":\"%s\",\"time\":%lu,\"elapsed\":%.3f,\"target\":", type_name[rec->type], (unsigned long) rec->time, rec->elapsed);
+		put_name(line, &len, rec->device);
+		put(line, &len, ",\"pass\":" OFFSTR ",\"depth\":%u,\"inflight\":%u,\"retries\":" OFFSTR, rec->pass, rec->depth, rec->inflight, rec->retries);
+	}
+	for(op = READER; op >= WRITER; op--) {
+		o = &rec->oper[op];
+		secs = (o->secs > 0) ? o->secs : 1;
+		if(bCSV) {
+			put(line, &len, ",%.3f," OFFSTR "," OFFSTR ",%.1f,%.1f," OFFSTR,
+				o->secs, o->bytes, o->count, (double) o->bytes / secs, (double) o->count / secs, o->errors);
+		} else {
+			put(line, &len, ",\"%c_secs\":%.3f,\"%c_bytes\":" OFFSTR ",\"%c_xfers\":" OFFSTR ",\"%c_bps\":%.1f,\"%c_iops\":%.1f,\"%c_errors\":" OFFSTR,
+				oper_name[op], o->secs, oper_name[op], o->bytes, oper_name[op], o->count,
+				oper_name[op], (double) o->bytes / secs, oper_name[op], (double) o->count / secs, oper_name[op], o->errors);
+		}
+		for(i = 0; i < STAT_LAT_VALS; i++) {
+			if(bCSV) {
+				put(line, &len, ",%.1f", o->lat[i]);
+			} else {
+				put(line, &len, ",\"%c_lat_%s\":%.1f", oper_name[op], lat_name[i], o->lat[i]);
+			}
+		}
+	}
+	put(line, &len, (bCSV) ? "\n" : "}\n");
+	fputs(line, fpLog);
+	fflush(fpLog);
+}
+
+/*
+ * Writes queued records until StatLogClose posts SemLOG with
+ * nothing left in the queue.
+ */
+#ifdef WINDOWS
+static DWORD WINAPI StatLogWriter(void *param)
+#else
+static void *StatLogWriter(void *param)
+#endif
+{
+	stat_node_t *node;
+	int rv = 0;
+
+	do {
+		SEM_WAIT(SemLOG);
+		LOCK(MutexLOG);
+		if((node = head) != NULL) {
+			if((head = node->next) == NULL) tail = NULL;
+			queued--;
+		}
+		UNLOCK(MutexLOG);
+		if(node) {
+			write_record(&node->rec);
+			FREE(node);
+		}
+	} while(node);
+
+	TEXIT(rv);
+}
+
+/*
+ * Opens the -O destination, "json:" or "csv:" followed by a file name,
+ * "-" for stdout, or "&n" for an fd that is already open.  Returns 0, or
+ * -1 with errno set when it could not be opened.
+ */
+int StatLogOpen(const char *spec)
+{
+	const char *dest;
+
+	if(strncmp(spec, "json:", 5) == 0) {
+		dest = spec + 5;
+		bCSV = FALSE;
+	} else if(strncmp(spec, "csv:", 4) == 0) {
+		dest = spec + 4;
+		bCSV = TRUE;
+	} else {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if(strcmp(dest, "-") == 0) {
+		fpLog = stdout;
+	} else if(dest[0] == '&') {
+		fpLog = fdopen(atoi(dest+1), "w");
+	} else {
+		fpLog = fopen(dest, "w");
+	}
+	if(fpLog == NULL) {
+		return -1;
+	}
+
+#ifdef WINDOWS
+	MutexLOG = CreateMutex(NULL, FALSE, NULL);
+	SemLOG = CreateSemaphore(NULL, 0, STAT_LOG_QUEUE+1, NULL);
+	if((MutexLOG == NULL) || (SemLOG == NULL)) {
+#else
+	if(sem_init(&SemLOG, 0, 0) != 0) {
+#endif
+		if(fpLog != stdout) fclose(fpLog);
+		fpLog = NULL;
+		return -1;
+	}
+
+	if(bCSV) write_csv_header();
+
+	if(!ISTHREADVALID(hWriter = spawnThread(StatLogWriter, NULL, NULL, 0))) {
+		if(fpLog != stdout) fclose(fpLog);
+		fpLog = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+BOOL StatLogActive(void)
+{
+	return (fpLog != NULL);
+}
+
+/*
+ * Queues a copy of rec for the writer, dropping it if the writer
+ * has fallen STAT_LOG_QUEUE records behind.
+ */
+void StatLogPut(const stat_record_t *rec)
+{
+	stat_node_t *node;
+
+	if(fpLog == NULL) return;
+	if((node = (stat_node_t *) ALLOC(sizeof(stat_node_t))) == NULL) {
+		dropped++;
+		return;
+	}
+	node->rec = *rec;
+	node->next = NULL;
+
+	LOCK(MutexLOG);
+	if(queued < STAT_LOG_QUEUE) {
+		if(tail) tail->next = node; else head = node;
+		tail = node;
+		queued++;
+		node = NULL;
+	} else {
+		dropped++;
+	}
+	UNLOCK(MutexLOG);
+
+	if(node) {
+		FREE(node);
+	} else {
+		SEM_POST(SemLOG, 1);
+	}
+}
+
+/*
+ * Lets the writer finish what is queued, and closes the destination.
+ * Returns the number of records that were dropped.
+ */
+unsigned long StatLogClose(void)
+{
+	if(fpLog == NULL) return 0;
+
+	SEM_POST(SemLOG, 1);
+	closeThread(hWriter);
+#ifdef WINDOWS
+	CloseHandle(MutexLOG);
+	CloseHandle(SemLOG);
+#else
+	sem_destroy(&SemLOG);
+#endif
+	if(fpLog == stdout) {
+		fflush(fpLog);
+	} else {
+		fclose(fpLog);
+	}
+	fpLog = NULL;
+	return dropped;
+}
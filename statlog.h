@@ -0,0 +1,69 @@
+/*
+* Disktest
+* Copyright (c) International Business Machines Corp., 2001
+*
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+*  Please send e-mail to yardleyb@us.ibm.com if you have
+*  questions or comments.
+*
+*  Project Website:  TBD
+*
+* $Id$
+*
+*/
+
+
+#ifndef _STATLOG_H
+#define _STATLOG_H 1
+
+#include "defs.h"
+#include "main.h"
+#include "stats.h"
+
+/*
+ * Stats records for -O, one for each heartbeat, cycle and the end of a
+ * test, written as JSON lines or CSV.  Records are queued and written
+ * by their own thread, so a slow reader never holds up the timer.
+ */
+#define STAT_LAT_VALS	7		/* min, mean, p50, p99, p99.9, p99.99, max */
+
+typedef struct stat_oper {
+	double secs;				/* time the rates are taken over */
+	OFF_T bytes;
+	OFF_T count;
+	OFF_T errors;
+	double lat[STAT_LAT_VALS];	/* usecs */
+} stat_oper_t;
+
+typedef struct stat_record {
+	statop_t type;
+	time_t time;				/* wall clock, when the record was taken */
+	double elapsed;				/* secs since disktest started */
+	char device[DEV_NAME_LEN];
+	OFF_T pass;
+	unsigned int depth;			/* transfers the target is allowed in flight */
+	unsigned int inflight;		/* transfers in flight when the record was taken */
+	OFF_T retries;
+	stat_oper_t oper[2];		/* indexed by WRITER and READER */
+} stat_record_t;
+
+int StatLogOpen(const char *);
+BOOL StatLogActive(void);
+void StatLogPut(const stat_record_t *);
+unsigned long StatLogClose(void);
+
+#endif /* _STATLOG_H */
@@ -52,68 +52,122 @@
 #include "sfunc.h"
 #include "threading.h"
 #include "stats.h"
+#include "latency.h"
+#include "timer.h"
+#include "statlog.h"
 
-void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
-{
-	extern time_t global_start_time;/* global pointer to overall start */
-	extern unsigned long glb_flags;	/* global flags GLB_FLG_xxx */
-
-	time_t curr_time = 0, hwrite_time = 0, hread_time = 0; //, write_time = 0, read_time = 0; //, gw_time = 0, gr_time = 0;
-	double write_time = 0.0, read_time = 0.0, gw_time = 0.0, gr_time = 0.0;
-	OFF_T h_wcount, h_rcount, h_rbytes, h_wbytes;
-	fmt_time_t time_struct;
+/*
+ * The time, in secs, that the heartbeat, cycle and total rates are taken over
+ */
+typedef struct stat_times {
+	double hread;
+	double hwrite;
+	double read;
+	double write;
+	double gread;
+	double gwrite;
+} stat_times_t;
 
-	curr_time = time(NULL);
+/*
+ * min, mean, p50, p99, p99.9, p99.99 and max of lat, in usecs
+ */
+static void latency_usecs(const latency_t *lat, double *v)
+{
+	v[0] = (double) LatencyMin(lat) / 1000.;
+	v[1] = LatencyMean(lat) / 1000.;
+	v[2] = (double) LatencyPercentile(lat, 50.0) / 1000.;
+	v[3] = (double) LatencyPercentile(lat, 99.0) / 1000.;
+	v[4] = (double) LatencyPercentile(lat, 99.9) / 1000.;
+	v[5] = (double) LatencyPercentile(lat, 99.99) / 1000.;
+	v[6] = (double) LatencyMax(lat) / 1000.;
+}
 
-	h_wcount = env->hbeat_stats.wcount;
-	h_rcount = env->hbeat_stats.rcount;
-	h_wbytes = env->hbeat_stats.wbytes;
-	h_rbytes = env->hbeat_stats.rbytes;
+/*
+ * Prints the min, mean, p50, p99, p99.9, p99.99 and max latency, in usecs
+ */
+static void print_latency(child_args_t *args, const char *fmt, const latency_t *lat)
+{
+	double v[STAT_LAT_VALS];
 
-	if((curr_time - env->start_time) == 0) curr_time++;
+	latency_usecs(lat, v);
+	pMsg(STAT, args, fmt, v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+}
 
+static void get_stat_times(const child_args_t *args, const test_env_t *env, stat_times_t *t)
+{
 	if((args->flags & CLD_FLG_LINEAR) && !(args->flags & CLD_FLG_NTRLVD)) {
-		hread_time = (time_t) env->hbeat_stats.rtime;
-		hwrite_time = (time_t) env->hbeat_stats.wtime;
-		read_time = env->cycle_stats.rtime;
-		write_time = env->cycle_stats.wtime;
+		t->hread = env->hbeat_stats.rtime;
+		t->hwrite = env->hbeat_stats.wtime;
+		t->read = env->cycle_stats.rtime;
+		t->write = env->cycle_stats.wtime;
 		if(env->global_stats.rtime > 0) { // cycle stats available
-			gr_time = env->global_stats.rtime;
+			t->gread = env->global_stats.rtime;
 		} else {
-			gr_time = (double)((double)(env->gr_stop_time-env->gr_start_time)/(double)(1000000));
+			t->gread = (double)((double)(env->gr_stop_time-env->gr_start_time)/(double)(NSECS_PER_SEC));
 		}
 		if(env->global_stats.wtime > 0) { // cycle stats available
-			gw_time = env->global_stats.wtime;
+			t->gwrite = env->global_stats.wtime;
 		} else {
-			gw_time = (double)((double)(env->gw_stop_time-env->gw_start_time)/(double)(1000000));
+			t->gwrite = (double)((double)(env->gw_stop_time-env->gw_start_time)/(double)(NSECS_PER_SEC));
 		}
 	} else {
-		hread_time = (time_t) ((env->hbeat_stats.rtime * args->rperc) / 100);
-		hwrite_time = (time_t) ((env->hbeat_stats.wtime * args->wperc) / 100);
-		read_time = ((env->cycle_stats.rtime * args->rperc) / 100);
-		write_time = ((env->cycle_stats.wtime * args->wperc) / 100);
+		t->hread = ((env->hbeat_stats.rtime * args->rperc) / 100);
+		t->hwrite = ((env->hbeat_stats.wtime * args->wperc) / 100);
+		t->read = ((env->cycle_stats.rtime * args->rperc) / 100);
+		t->write = ((env->cycle_stats.wtime * args->wperc) / 100);
 		if(env->global_stats.rtime > 0) { // cycle stats available
-			gr_time = env->global_stats.rtime;
+			t->gread = env->global_stats.rtime;
 		} else {
-//printf("Start_time: %.2f, stop_time: %.2f\n", (double) env->gr_start_time, (double) env->gr_stop_time);
-			gr_time = (double)((double)(env->gr_stop_time-env->gr_start_time)/(double)(1000000));
+			t->gread = (double)((double)(env->gr_stop_time-env->gr_start_time)/(double)(NSECS_PER_SEC));
 		}
 		if(env->global_stats.wtime > 0) { // cycle stats available
-			gw_time = env->global_stats.wtime;
+			t->gwrite = env->global_stats.wtime;
 		} else {
-			gw_time = (double)((double)(env->gw_stop_time-env->gw_start_time)/(double)(1000000));
+			t->gwrite = (double)((double)(env->gw_stop_time-env->gw_start_time)/(double)(NSECS_PER_SEC));
 		}
-		gr_time = (double) ((gr_time * args->rperc) / (double)100);
-		gw_time = (double) ((gw_time * args->wperc) / (double)100);
+		t->gread = (double) ((t->gread * args->rperc) / (double)100);
+		t->gwrite = (double) ((t->gwrite * args->wperc) / (double)100);
 	}
 
-	/* if one second really has not passed, then make it at least one second */
-	if(hread_time == 0) hread_time++;
-	if(hwrite_time == 0) hwrite_time++;
-	if(read_time == 0) read_time++;
-	if(write_time == 0) write_time++;
-	if(gr_time == 0) gr_time++;
-	if(gw_time == 0) gw_time++;
+	/* no time has been accounted yet, avoid dividing by zero */
+	if(t->hread == 0) t->hread++;
+	if(t->hwrite == 0) t->hwrite++;
+	if(t->read == 0) t->read++;
+	if(t->write == 0) t->write++;
+	if(t->gread == 0) t->gread++;
+	if(t->gwrite == 0) t->gwrite++;
+}
+
+void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
+{
+	extern OFF_T global_start_time;	/* global pointer to overall start */
+	extern unsigned long glb_flags;	/* global flags GLB_FLG_xxx */
+
+	OFF_T curr_time = 0;
+	double hwrite_time = 0.0, hread_time = 0.0, write_time = 0.0, read_time = 0.0, gw_time = 0.0, gr_time = 0.0;
+	double run_time, total_time;
+	stat_times_t t;
+	OFF_T h_wcount, h_rcount, h_rbytes, h_wbytes;
+	fmt_time_t time_struct;
+
+	curr_time = getMonoTime();
+
+	collect_stats(args, env);
+	h_wcount = env->hbeat_stats.wcount;
+	h_rcount = env->hbeat_stats.rcount;
+	h_wbytes = env->hbeat_stats.wbytes;
+	h_rbytes = env->hbeat_stats.rbytes;
+
+	run_time = (double) (curr_time - env->start_mono) / (double) NSECS_PER_SEC;
+	total_time = (double) (curr_time - global_start_time) / (double) NSECS_PER_SEC;
+
+	get_stat_times(args, env, &t);
+	hread_time = t.hread;
+	hwrite_time = t.hwrite;
+	read_time = t.read;
+	write_time = t.write;
+	gr_time = t.gread;
+	gw_time = t.gwrite;
 
 	if(glb_flags & GLB_FLG_PERFP) {
 		if(args->flags & CLD_FLG_PRFTYPS) {
@@ -130,7 +184,7 @@ void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
 					printf(CTRWSTR, ((double)(h_wbytes) / (double)(hwrite_time)), ((double)(h_wcount) / (double)(hwrite_time)));
 				}
 				if((args->flags & CLD_FLG_RUNT)) {
-					printf("%lu;Rsecs;%lu;Wsecs;", hread_time, hwrite_time);
+					printf("%.2f;Rsecs;%.2f;Wsecs;", hread_time, hwrite_time);
 				}
 				break;
 			case CYCLE: /* only display current CYCLE stats */
@@ -156,7 +210,7 @@ void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
 					printf(TCTRWSTR, ((double)(env->global_stats.wbytes) / (double)(gw_time)), ((double)(env->global_stats.wcount) / (double)(gw_time)));
 				}
 				if((args->flags & CLD_FLG_RUNT)) {
-					printf("%lu;secs;",(curr_time - env->start_time));
+					printf("%.2f;secs;", run_time);
 				}
 				break;
 			default:
@@ -206,12 +260,18 @@ void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
 							((double) h_rbytes / (double) (hread_time)),
 							(((double) h_rbytes / (double) hread_time) / (double) 1048576.),
 							((double) h_rcount / (double) (hread_time)));
+						if(env->hbeat_lat[READER].count > 0) {
+							print_latency(args, HRLATSTR, &env->hbeat_lat[READER]);
+						}
 					}
 					if(args->flags & CLD_FLG_W) {
 						pMsg(STAT, args, HWTHSTR,
 							((double) h_wbytes / (double) hwrite_time),
 							(((double) h_wbytes / (double) hwrite_time) / (double) 1048576.),
 							((double) h_wcount / (double) hwrite_time));
+						if(env->hbeat_lat[WRITER].count > 0) {
+							print_latency(args, HWLATSTR, &env->hbeat_lat[WRITER]);
+						}
 					}
 					break;
 				case CYCLE: /* only display current read stats */
@@ -220,12 +280,18 @@ void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
 							((double) env->cycle_stats.rbytes / (double) (read_time)),
 							(((double) env->cycle_stats.rbytes / (double) read_time) / (double) 1048576.),
 							((double) env->cycle_stats.rcount / (double) (read_time)));
+						if(env->cycle_lat[READER].count > 0) {
+							print_latency(args, CRLATSTR, &env->cycle_lat[READER]);
+						}
 					}
 					if(args->flags & CLD_FLG_W) {
 						pMsg(STAT, args, CWTHSTR,
 							((double) env->cycle_stats.wbytes / (double) write_time),
 							(((double) env->cycle_stats.wbytes / (double) write_time) / (double) 1048576.),
 							((double) env->cycle_stats.wcount / (double) write_time));
+						if(env->cycle_lat[WRITER].count > 0) {
+							print_latency(args, CWLATSTR, &env->cycle_lat[WRITER]);
+						}
 					}
 					break;
 				case TOTAL: /* display total read and write stats */
@@ -234,12 +300,18 @@ void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
 							((double) env->global_stats.rbytes / (double) gr_time),
 							(((double) env->global_stats.rbytes / (double) gr_time) / (double) 1048576.),
 							((double) env->global_stats.rcount / (double) gr_time));
+						if(env->global_lat[READER].count > 0) {
+							print_latency(args, TRLATSTR, &env->global_lat[READER]);
+						}
 					}
 					if(args->flags & CLD_FLG_W) {
 						pMsg(STAT, args, TWTHSTR,
 							((double) env->global_stats.wbytes / (double) gw_time),
 							(((double) env->global_stats.wbytes / (double) gw_time) / (double) 1048576.),
 							((double) env->global_stats.wcount / (double) gw_time));
+						if(env->global_lat[WRITER].count > 0) {
+							print_latency(args, TWLATSTR, &env->global_lat[WRITER]);
+						}
 					}
 					break;
 				default:
@@ -250,35 +322,35 @@ void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
 			switch(operation) {
 				case HBEAT: /* only display current cycle stats */
 					if(args->flags & CLD_FLG_R) {
-						time_struct = format_time(hread_time);
-						pMsg(STAT,args,"Heartbeat Read Time: %u seconds (%luh%lum%lus)\n", hread_time, time_struct.hours, time_struct.minutes, time_struct.seconds);
+						time_struct = format_time((time_t)(hread_time + 0.5));
+						pMsg(STAT,args,"Heartbeat Read Time: %.2f seconds (%luh%lum%lus)\n", hread_time, time_struct.hours, time_struct.minutes, time_struct.seconds);
 					}
 					if(args->flags & CLD_FLG_W) {
-						time_struct = format_time(hwrite_time);
-						pMsg(STAT,args,"Heartbeat Write Time: %u seconds (%luh%lum%lus)\n", hwrite_time, time_struct.hours, time_struct.minutes, time_struct.seconds);
+						time_struct = format_time((time_t)(hwrite_time + 0.5));
+						pMsg(STAT,args,"Heartbeat Write Time: %.2f seconds (%luh%lum%lus)\n", hwrite_time, time_struct.hours, time_struct.minutes, time_struct.seconds);
 					}
 					break;
 				case CYCLE: /* only display current cycle stats */
 					if(args->flags & CLD_FLG_R) {
-						time_struct = format_time((time_t)read_time);
+						time_struct = format_time((time_t)(read_time + 0.5));
 						pMsg(STAT,args,"Cycle Read Time: %.2f seconds (%luh%lum%lus)\n", read_time, time_struct.hours, time_struct.minutes, time_struct.seconds);
 					}
 					if(args->flags & CLD_FLG_W) {
-						time_struct = format_time((time_t)write_time);
+						time_struct = format_time((time_t)(write_time + 0.5));
 						pMsg(STAT,args,"Cycle Write Time: %.2f seconds (%luh%lum%lus)\n", write_time, time_struct.hours, time_struct.minutes, time_struct.seconds);
 					}
 					break;
 				case TOTAL:
 					if(args->flags & CLD_FLG_R) {
-						time_struct = format_time((time_t)gr_time);
+						time_struct = format_time((time_t)(gr_time + 0.5));
 						pMsg(STAT,args, "Total Read Time: %.2f seconds (%lud%luh%lum%lus)\n", gr_time, time_struct.days, time_struct.hours, time_struct.minutes, time_struct.seconds);
 					}
 					if(args->flags & CLD_FLG_W) {
-						time_struct = format_time((time_t)gw_time);
+						time_struct = format_time((time_t)(gw_time + 0.5));
 						pMsg(STAT,args, "Total Write Time: %.2f seconds (%lud%luh%lum%lus)\n", gw_time, time_struct.days, time_struct.hours, time_struct.minutes, time_struct.seconds);
 					}
-					time_struct = format_time((curr_time - global_start_time));
-					pMsg(STAT,args, "Total overall runtime: %u seconds (%lud%luh%lum%lus)\n", (curr_time - global_start_time), time_struct.days, time_struct.hours, time_struct.minutes, time_struct.seconds);
+					time_struct = format_time((time_t)(total_time + 0.5));
+					pMsg(STAT,args, "Total overall runtime: %.2f seconds (%lud%luh%lum%lus)\n", total_time, time_struct.days, time_struct.hours, time_struct.minutes, time_struct.seconds);
 					break;
 				default:
 					pMsg(ERR, args, "Unknown stats display type.\n");
@@ -290,6 +362,74 @@ void print_stats(child_args_t *args, test_env_t *env, statop_t operation)
 
 }
 
+/*
+ * Queues a -O record for the heartbeat, cycle or total stats.  It takes
+ * the stats as they are, so a heartbeat record is taken right after
+ * print_stats has collected them.
+ */
+void log_stats(const child_args_t *args, const test_env_t *env, const statop_t operation)
+{
+	extern OFF_T global_start_time;
+
+	stat_record_t rec;
+	stat_times_t t;
+	const stats_t *stats;
+	const latency_t *lat;
+	int i;
+
+	if(!StatLogActive()) return;
+
+	get_stat_times(args, env, &t);
+	memset(&rec, 0, sizeof(stat_record_t));
+	rec.type = operation;
+	rec.time = time(NULL);
+	rec.elapsed = (double) (getMonoTime() - global_start_time) / (double) NSECS_PER_SEC;
+	memcpy(rec.device, args->device, DEV_NAME_LEN);
+	rec.device[DEV_NAME_LEN-1] = '\0';
+	rec.pass = env->pass_count;
+	rec.depth = args->t_kids * args->io_depth;
+	for(i = 0; i < args->t_kids; i++) {
+		rec.inflight += env->thread_stats[i].inflight;
+	}
+
+	switch(operation) {
+		case HBEAT:
+			stats = &env->hbeat_stats;
+			lat = env->hbeat_lat;
+			rec.oper[READER].secs = t.hread;
+			rec.oper[WRITER].secs = t.hwrite;
+			break;
+		case CYCLE:
+			stats = &env->cycle_stats;
+			lat = env->cycle_lat;
+			rec.oper[READER].secs = t.read;
+			rec.oper[WRITER].secs = t.write;
+			break;
+		default:
+			stats = &env->global_stats;
+			lat = env->global_lat;
+			rec.oper[READER].secs = t.gread;
+			rec.oper[WRITER].secs = t.gwrite;
+			break;
+	}
+
+	/* no time for an operation that is not part of the test */
+	if(!(args->flags & CLD_FLG_R)) rec.oper[READER].secs = 0;
+	if(!(args->flags & CLD_FLG_W)) rec.oper[WRITER].secs = 0;
+
+	rec.retries = stats->retries;
+	rec.oper[READER].bytes = stats->rbytes;
+	rec.oper[READER].count = stats->rcount;
+	rec.oper[READER].errors = stats->rerrors;
+	rec.oper[WRITER].bytes = stats->wbytes;
+	rec.oper[WRITER].count = stats->wcount;
+	rec.oper[WRITER].errors = stats->werrors;
+	latency_usecs(&lat[READER], rec.oper[READER].lat);
+	latency_usecs(&lat[WRITER], rec.oper[WRITER].lat);
+
+	StatLogPut(&rec);
+}
+
 void update_gbl_stats(test_env_t *env)
 {
 	env->global_stats.wcount += env->cycle_stats.wcount;
@@ -298,6 +438,9 @@ void update_gbl_stats(test_env_t *env)
 	env->global_stats.rbytes += env->cycle_stats.rbytes;
 	env->global_stats.wtime += env->cycle_stats.wtime;
 	env->global_stats.rtime += env->cycle_stats.rtime;
+	env->global_stats.werrors += env->cycle_stats.werrors;
+	env->global_stats.rerrors += env->cycle_stats.rerrors;
+	env->global_stats.retries += env->cycle_stats.retries;
 
 	env->cycle_stats.wcount = 0;
 	env->cycle_stats.rcount = 0;
@@ -305,17 +448,37 @@ void update_gbl_stats(test_env_t *env)
 	env->cycle_stats.rbytes = 0;
 	env->cycle_stats.wtime = 0;
 	env->cycle_stats.rtime = 0;
+	env->cycle_stats.werrors = 0;
+	env->cycle_stats.rerrors = 0;
+	env->cycle_stats.retries = 0;
+
+	LatencyAdd(&env->global_lat[WRITER], &env->cycle_lat[WRITER]);
+	LatencyAdd(&env->global_lat[READER], &env->cycle_lat[READER]);
+	LatencyClear(&env->cycle_lat[WRITER]);
+	LatencyClear(&env->cycle_lat[READER]);
 }
 
 void update_cyc_stats(const child_args_t *args, test_env_t *env)
 {
+	collect_stats(args, env);
+	env->stats_base.wcount += env->hbeat_stats.wcount;
+	env->stats_base.rcount += env->hbeat_stats.rcount;
+	env->stats_base.wbytes += env->hbeat_stats.wbytes;
+	env->stats_base.rbytes += env->hbeat_stats.rbytes;
+	env->stats_base.werrors += env->hbeat_stats.werrors;
+	env->stats_base.rerrors += env->hbeat_stats.rerrors;
+	env->stats_base.retries += env->hbeat_stats.retries;
+
 	env->cycle_stats.wcount += env->hbeat_stats.wcount;
 	env->cycle_stats.rcount += env->hbeat_stats.rcount;
 	env->cycle_stats.wbytes += env->hbeat_stats.wbytes;
 	env->cycle_stats.rbytes += env->hbeat_stats.rbytes;
+	env->cycle_stats.werrors += env->hbeat_stats.werrors;
+	env->cycle_stats.rerrors += env->hbeat_stats.rerrors;
+	env->cycle_stats.retries += env->hbeat_stats.retries;
 	if(args->flags & CLD_FLG_CYC) {
-		env->cycle_stats.wtime = (double)((env->gw_stop_time - env->gw_start_time) / (double)(1000000));
-		env->cycle_stats.rtime = (double)((env->gr_stop_time - env->gr_start_time) / (double)(1000000));
+		env->cycle_stats.wtime = (double)((env->gw_stop_time - env->gw_start_time) / (double)(NSECS_PER_SEC));
+		env->cycle_stats.rtime = (double)((env->gr_stop_time - env->gr_start_time) / (double)(NSECS_PER_SEC));
 	}
 
 	env->hbeat_stats.wcount = 0;
@@ -324,4 +487,49 @@ void update_cyc_stats(const child_args_t *args, test_env_t *env)
 	env->hbeat_stats.rbytes = 0;
 	env->hbeat_stats.wtime = 0;
 	env->hbeat_stats.rtime = 0;
+	env->hbeat_stats.werrors = 0;
+	env->hbeat_stats.rerrors = 0;
+	env->hbeat_stats.retries = 0;
+
+	LatencyAdd(&env->lat_base[WRITER], &env->hbeat_lat[WRITER]);
+	LatencyAdd(&env->lat_base[READER], &env->hbeat_lat[READER]);
+	LatencyAdd(&env->cycle_lat[WRITER], &env->hbeat_lat[WRITER]);
+	LatencyAdd(&env->cycle_lat[READER], &env->hbeat_lat[READER]);
+	LatencyClear(&env->hbeat_lat[WRITER]);
+	LatencyClear(&env->hbeat_lat[READER]);
+}
+
+/*
+ * Sums the IO counts and latencies kept by each thread.  What has not
+ * been moved to cycle_stats yet is the count for this heartbeat.
+ */
+void collect_stats(const child_args_t *args, test_env_t *env)
+{
+	OFF_T wcount = 0, rcount = 0, wbytes = 0, rbytes = 0;
+	OFF_T werrors = 0, rerrors = 0, retries = 0;
+	int i;
+
+	LatencyClear(&env->hbeat_lat[WRITER]);
+	LatencyClear(&env->hbeat_lat[READER]);
+	for(i = 0; i < args->t_kids; i++) {
+		wcount += env->thread_stats[i].wcount;
+		rcount += env->thread_stats[i].rcount;
+		wbytes += env->thread_stats[i].wbytes;
+		rbytes += env->thread_stats[i].rbytes;
+		werrors += env->thread_stats[i].werrors;
+		rerrors += env->thread_stats[i].rerrors;
+		retries += env->thread_stats[i].retries;
+		LatencyAdd(&env->hbeat_lat[WRITER], &env->thread_lat[2*i+WRITER]);
+		LatencyAdd(&env->hbeat_lat[READER], &env->thread_lat[2*i+READER]);
+	}
+	LatencySub(&env->hbeat_lat[WRITER], &env->lat_base[WRITER]);
+	LatencySub(&env->hbeat_lat[READER], &env->lat_base[READER]);
+
+	env->hbeat_stats.wcount = wcount - env->stats_base.wcount;
+	env->hbeat_stats.rcount = rcount - env->stats_base.rcount;
+	env->hbeat_stats.wbytes = wbytes - env->stats_base.wbytes;
+	env->hbeat_stats.rbytes = rbytes - env->stats_base.rbytes;
+	env->hbeat_stats.werrors = werrors - env->stats_base.werrors;
+	env->hbeat_stats.rerrors = rerrors - env->stats_base.rerrors;
+	env->hbeat_stats.retries = retries - env->stats_base.retries;
 }
@@ -78,6 +78,12 @@
 #define CWTHSTR "Cycle write throughput: %.1fB/s (%.2fMB/s), IOPS %.1f/s.\n"
 #define TRTHSTR "Total read throughput: %.1fB/s (%.2fMB/s), IOPS %.1f/s.\n"
 #define TWTHSTR "Total write throughput: %.1fB/s (%.2fMB/s), IOPS %.1f/s.\n"
+#define HRLATSTR "Heartbeat read latency: min %.1fus, mean %.1fus, p50 %.1fus, p99 %.1fus, p99.9 %.1fus, p99.99 %.1fus, max %.1fus.\n"
+#define HWLATSTR "Heartbeat write latency: min %.1fus, mean %.1fus, p50 %.1fus, p99 %.1fus, p99.9 %.1fus, p99.99 %.1fus, max %.1fus.\n"
+#define CRLATSTR "Cycle read latency: min %.1fus, mean %.1fus, p50 %.1fus, p99 %.1fus, p99.9 %.1fus, p99.99 %.1fus, max %.1fus.\n"
+#define CWLATSTR "Cycle write latency: min %.1fus, mean %.1fus, p50 %.1fus, p99 %.1fus, p99.9 %.1fus, p99.99 %.1fus, max %.1fus.\n"
+#define TRLATSTR "Total read latency: min %.1fus, mean %.1fus, p50 %.1fus, p99 %.1fus, p99.9 %.1fus, p99.99 %.1fus, max %.1fus.\n"
+#define TWLATSTR "Total write latency: min %.1fus, mean %.1fus, p50 %.1fus, p99 %.1fus, p99.9 %.1fus, p99.99 %.1fus, max %.1fus.\n"
 #define CTRRSTR "%.1f;RB/s;%.1f;RIOPS;"
 #define CTRWSTR "%.1f;WB/s;%.1f;WIOPS;"
 #define TCTRRSTR "%.1f;TRB/s;%.1f;TRIOPS;"
@@ -89,7 +95,9 @@ typedef enum statop {
 
 
 void print_stats(child_args_t *, test_env_t *, statop_t);
+void log_stats(const child_args_t *, const test_env_t *, const statop_t);
 void update_gbl_stats(test_env_t *);
 void update_cyc_stats(const child_args_t *, test_env_t *);
+void collect_stats(const child_args_t *, test_env_t *);
 
 #endif /* _STATS_H */
@@ -105,15 +105,28 @@
 #else
 #include <pthread.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+#endif
+#ifdef LINUX
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #endif
 
 #include "defs.h"
 #include "sfunc.h"
 #include "main.h"
 #include "childmain.h"
+#include "timer.h"
 #include "threading.h"
+#include "rate.h"
 
 /*
  * This routine will sit waiting for all threads to exit.  In
@@ -136,17 +149,150 @@ void cleanUpTestChildren(test_ll_t *test)
 	}
 }
 
+/*
+ * The pool children are created once for each target, and kept
+ * for all passes and cycles.  Between passes they wait on CondPOOL
+ * for pass_gen to change, and the last one to finish a pass posts SemDONE.
+ */
+void CreateTestPool(test_ll_t *test)
+{
+	thread_struct_t *pThreads = test->env->pThreads;
+	int i;
+
+	test->env->bPoolExit = FALSE;
+	test->env->pass_gen = 0;
+	test->env->pThreads = NULL;
+	for(i=0;i<test->args->t_kids;i++) {
+		if(test->env->child_cpus.count > 0) {
+			/* one CPU for each child, round robin, so runs place the same */
+			CreateTestChild(ChildMain, test, &test->env->child_cpus.cpu[i % test->env->child_cpus.count], 1);
+		} else {
+			CreateTestChild(ChildMain, test, NULL, 0);
+		}
+	}
+	test->env->pPool = test->env->pThreads;
+	test->env->pThreads = pThreads;
+}
+
+/*
+ * Runs a pass with the pool children.  The timer is still
+ * started for each pass, it exits as soon as the pool is done.
+ */
+void RunTestPool(test_ll_t *test)
+{
+	/* each pass starts a new arrival schedule, so the time between passes isn't owed */
+	RateInit(&test->env->arrival, test->args->arrival_rate);
+	CreateTestChild(ChildTimer, test, test->env->timer_cpus.cpu, test->env->timer_cpus.count);
+	LOCK(test->env->mutexs.MutexPOOL);
+	test->env->active = test->args->t_kids;
+	test->env->pass_gen++;
+	COND_BROADCAST(test->env->mutexs.CondPOOL);
+	UNLOCK(test->env->mutexs.MutexPOOL);
+	/* Wait for the timer, then for the pool children to finish */
+	cleanUpTestChildren(test);
+	SEM_WAIT(test->env->mutexs.SemDONE);
+}
+
+void cleanUpTestPool(test_ll_t *test)
+{
+	thread_struct_t *pThreads = test->env->pThreads;
+
+	LOCK(test->env->mutexs.MutexPOOL);
+	test->env->bPoolExit = TRUE;
+	test->env->pass_gen++;
+	COND_BROADCAST(test->env->mutexs.CondPOOL);
+	UNLOCK(test->env->mutexs.MutexPOOL);
+	test->env->pThreads = test->env->pPool;
+	cleanUpTestChildren(test);
+	test->env->pPool = NULL;
+	test->env->pThreads = pThreads;
+}
+
+#ifndef WINDOWS
+/*
+ * glibc 2.30 can wait against the monotonic clock, so a step
+ * of the wall clock does not stretch or cut short a timeout.
+ */
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+#if __GLIBC_PREREQ(2, 30)
+#define HAVE_CLOCKWAIT 1
+#endif
+#endif
+
+#ifdef HAVE_CLOCKWAIT
+#define WAIT_CLOCK CLOCK_MONOTONIC
+#else
+#define WAIT_CLOCK CLOCK_REALTIME
+#endif
+
+/*
+ * pthread_cond_timedwait and sem_timedwait take an absolute
+ * time, so turn msec from now into one.
+ */
+void abs_timeout(struct timespec *ts, unsigned long msec)
+{
+	clock_gettime(WAIT_CLOCK, ts);
+	ts->tv_sec += (msec / 1000);
+	ts->tv_nsec += ((msec % 1000) * 1000000);
+	if(ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+int cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, unsigned long msec)
+{
+	struct timespec ts;
+
+	abs_timeout(&ts, msec);
+#ifdef HAVE_CLOCKWAIT
+	return pthread_cond_clockwait(cond, mutex, WAIT_CLOCK, &ts);
+#else
+	return pthread_cond_timedwait(cond, mutex, &ts);
+#endif
+}
+
+/*
+ * waits on sem for up to msec, or forever if msec is zero,
+ * not giving up if a signal interrupts the wait
+ */
+int sem_timedwait_ms(sem_t *sem, unsigned long msec)
+{
+	struct timespec ts;
+	int rv;
+
+	if(msec == 0) {
+		while(((rv = sem_wait(sem)) != 0) && (errno == EINTR));
+	} else {
+		abs_timeout(&ts, msec);
+#ifdef HAVE_CLOCKWAIT
+		while(((rv = sem_clockwait(sem, WAIT_CLOCK, &ts)) != 0) && (errno == EINTR));
+#else
+		while(((rv = sem_timedwait(sem, &ts)) != 0) && (errno == EINTR));
+#endif
+	}
+	return rv;
+}
+
+void sem_post_n(sem_t *sem, unsigned int count)
+{
+	while(count-- > 0) {
+		sem_post(sem);
+	}
+}
+#endif
+
 /*
  * This function will create children for us based on the action specified
  * during the call.  if we cannot create a child, we fail and exit with
  * errno as the exit status.
  */
-void CreateTestChild(void *function, test_ll_t *test)
+void CreateTestChild(void *function, test_ll_t *test, const unsigned int *cpus, const unsigned int ncpus)
 {
 	thread_struct_t *pNewThread;
 	hThread_t hTmpThread;
 
-	hTmpThread = spawnThread(function, test);
+	hTmpThread = spawnThread(function, test, cpus, ncpus);
 
 	if(ISTHREADVALID(hTmpThread)) {
 		if((pNewThread = (thread_struct_t *) ALLOC(sizeof(thread_struct_t))) == NULL) {
@@ -168,7 +314,7 @@ void CreateTestChild(void *function, test_ll_t *test)
 void createChild(void *function, test_ll_t *test) {
 	hThread_t hTmpThread;
 
-	hTmpThread = spawnThread(function, test);
+	hTmpThread = spawnThread(function, test, NULL, 0);
 
 	if(ISTHREADVALID(hTmpThread)) {
 		test->hThread = hTmpThread;
@@ -186,17 +332,44 @@ void cleanUp(test_ll_t *test) {
 		pTmpTest = pTmpTest->next;
 		closeThread(pLastTest->hThread);
 		FREE(pLastTest->env->action_list);
+		FREE(pLastTest->env->action_hash);
+		FREE(pLastTest->env->thread_stats_mem);
+		if(pLastTest->env->thread_lat) FREE(pLastTest->env->thread_lat);
+		if(pLastTest->env->child_cpus.cpu) FREE(pLastTest->env->child_cpus.cpu);
+		if(pLastTest->env->timer_cpus.cpu) FREE(pLastTest->env->timer_cpus.cpu);
 		FREE(pLastTest->args);
 		FREE(pLastTest->env);
 		FREE(pLastTest);
 	}
 }
 
-hThread_t spawnThread(void *function, void *param) {
+/*
+ * Creates a thread, bound to the ncpus CPUs in cpus, or left to the
+ * scheduler when ncpus is 0.
+ */
+hThread_t spawnThread(void *function, void *param, const unsigned int *cpus, const unsigned int ncpus) {
 	hThread_t hTmpThread;
+#ifdef LINUX
+	pthread_attr_t attr;
+	cpu_set_t set;
+	unsigned int i;
+#endif
 
 #ifdef WINDOWS
 	hTmpThread = CreateThread(NULL, 0, function, param, 0, NULL);
+#elif defined(LINUX)
+	pthread_attr_init(&attr);
+	if(ncpus > 0) {
+		CPU_ZERO(&set);
+		for(i=0;i<ncpus;i++) {
+			CPU_SET(cpus[i], &set);
+		}
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+	if(pthread_create(&hTmpThread, &attr, function, param) != 0) {
+		hTmpThread = 0;
+	}
+	pthread_attr_destroy(&attr);
 #else
 	if(pthread_create(&hTmpThread, NULL, function, param) != 0) {
 		hTmpThread = 0;
@@ -206,6 +379,182 @@ hThread_t spawnThread(void *function, void *param) {
 	return hTmpThread;
 }
 
+#ifdef LINUX
+/*
+ * Parses a CPU list, "0-3,8", in the format of the sysfs cpulist files.
+ */
+static int parse_cpu_list(const char *str, cpu_set_t *set)
+{
+	const char *p = str;
+	char *end;
+	unsigned long lo, hi, cpu;
+
+	CPU_ZERO(set);
+	while((*p != '\0') && (*p != '\n')) {
+		lo = hi = strtoul(p, &end, 10);
+		if(end == p) return -1;
+		if(*end == '-') {
+			p = end+1;
+			hi = strtoul(p, &end, 10);
+			if((end == p) || (hi < lo)) return -1;
+		}
+		if(hi >= CPU_SETSIZE) return -1;
+		for(cpu=lo;cpu<=hi;cpu++) {
+			CPU_SET(cpu, set);
+		}
+		p = end;
+		if(*p == ',') p++;
+	}
+	return 0;
+}
+
+static int read_sysfs(const char *path, char *buf, const int len)
+{
+	FILE *fp;
+	char *rv;
+
+	if((fp = fopen(path, "r")) == NULL) return -1;
+	rv = fgets(buf, len, fp);
+	fclose(fp);
+	return (rv == NULL) ? -1 : 0;
+}
+
+/*
+ * The NUMA node of the device holding the target, from sysfs.  For a
+ * partition, the node is found on its parent disk.  Returns -1 if the
+ * node is not known.
+ */
+static int device_numa_node(const char *device)
+{
+	static const char *paths[] = { "device/numa_node", "device/device/numa_node", "../device/numa_node", "../device/device/numa_node" };
+	struct stat st;
+	dev_t dev;
+	char path[128], buf[16];
+	unsigned int i;
+
+	if(stat(device, &st) != 0) return -1;
+	dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+	for(i=0;i<sizeof(paths)/sizeof(paths[0]);i++) {
+		snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/%s", major(dev), minor(dev), paths[i]);
+		if(read_sysfs(path, buf, sizeof(buf)) == 0) {
+			return atoi(buf);
+		}
+	}
+	return -1;
+}
+
+/*
+ * Turns a -b CPU list, or "n" for the CPUs of the target's NUMA node,
+ * into a cpu_list_t.
+ */
+static int make_cpu_list(test_ll_t *test, const char *str, cpu_list_t *list)
+{
+	cpu_set_t set, allowed;
+	char path[64], buf[CPU_LIST_LEN*4];
+	unsigned int cpu;
+
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	if(strcmp(str, "n") == 0) {
+		if(test->env->numa_node < 0) {
+			test->env->numa_node = device_numa_node(test->args->device);
+		}
+		if(test->env->numa_node < 0) {
+			pMsg(WARN, test->args, "NUMA node of %s is not known, using all CPUs\n", test->args->device);
+			set = allowed;
+		} else {
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", test->env->numa_node);
+			if((read_sysfs(path, buf, sizeof(buf)) != 0) || (parse_cpu_list(buf, &set) != 0)) {
+				pMsg(ERR, test->args, "Could not read the CPUs of NUMA node %d\n", test->env->numa_node);
+				return(-1);
+			}
+			CPU_AND(&set, &set, &allowed);
+		}
+	} else {
+		if(parse_cpu_list(str, &set) != 0) {
+			pMsg(ERR, test->args, "Invalid CPU list: %s\n", str);
+			return(-1);
+		}
+		CPU_AND(&allowed, &allowed, &set);
+		if(!CPU_EQUAL(&allowed, &set)) {
+			pMsg(ERR, test->args, "CPU list %s has CPUs that are not available\n", str);
+			return(-1);
+		}
+	}
+	if((list->count = CPU_COUNT(&set)) == 0) {
+		pMsg(ERR, test->args, "No CPUs available to bind threads to\n");
+		return(-1);
+	}
+	if((list->cpu = (unsigned int *) ALLOC(list->count*sizeof(unsigned int))) == NULL) {
+		pMsg(ERR, test->args, "Failed to allocate CPU list memory.\n");
+		return(-1);
+	}
+	for(cpu=0, list->count=0;cpu<CPU_SETSIZE;cpu++) {
+		if(CPU_ISSET(cpu, &set)) list->cpu[list->count++] = cpu;
+	}
+	return 0;
+}
+
+static void format_cpu_list(const cpu_list_t *list, char *buf, const size_t len)
+{
+	unsigned int i, j;
+	size_t n = 0;
+
+	buf[0] = '\0';
+	for(i=0;(i<list->count) && (n < len);i=j+1) {
+		for(j=i;(j+1<list->count) && (list->cpu[j+1] == list->cpu[j]+1);j++);
+		if(j == i) {
+			n += snprintf(buf+n, len-n, "%s%u", (i > 0) ? "," : "", list->cpu[i]);
+		} else {
+			n += snprintf(buf+n, len-n, "%s%u-%u", (i > 0) ? "," : "", list->cpu[i], list->cpu[j]);
+		}
+	}
+}
+#endif
+
+/*
+ * Works out the CPUs the test children and timer are bound to with -b.
+ * The timer uses the children's CPUs, unless it was given its own.
+ */
+int initAffinity(test_ll_t *test)
+{
+	test->env->numa_node = -1;
+#ifdef LINUX
+	if(!(test->args->flags & CLD_FLG_AFFINITY)) return 0;
+	if(make_cpu_list(test, test->args->child_cpus, &test->env->child_cpus) < 0) {
+		return(-1);
+	}
+	if(test->args->timer_cpus[0] != '\0') {
+		if(make_cpu_list(test, test->args->timer_cpus, &test->env->timer_cpus) < 0) {
+			return(-1);
+		}
+	} else {
+		if((test->env->timer_cpus.cpu = (unsigned int *) ALLOC(test->env->child_cpus.count*sizeof(unsigned int))) == NULL) {
+			pMsg(ERR, test->args, "Failed to allocate CPU list memory.\n");
+			return(-1);
+		}
+		memcpy(test->env->timer_cpus.cpu, test->env->child_cpus.cpu, test->env->child_cpus.count*sizeof(unsigned int));
+		test->env->timer_cpus.count = test->env->child_cpus.count;
+	}
+#endif
+	return 0;
+}
+
+void reportAffinity(test_ll_t *test)
+{
+#ifdef LINUX
+	char child_cpus[CPU_LIST_LEN*4], timer_cpus[CPU_LIST_LEN*4];
+
+	if(test->env->child_cpus.count == 0) return;
+	format_cpu_list(&test->env->child_cpus, child_cpus, sizeof(child_cpus));
+	format_cpu_list(&test->env->timer_cpus, timer_cpus, sizeof(timer_cpus));
+	if(test->env->numa_node >= 0) {
+		pMsg(START, test->args, "Threads bound to CPUs %s, timer to CPUs %s, on NUMA node %d\n", child_cpus, timer_cpus, test->env->numa_node);
+	} else {
+		pMsg(START, test->args, "Threads bound to CPUs %s, timer to CPUs %s\n", child_cpus, timer_cpus);
+	}
+#endif
+}
+
 void closeThread(hThread_t hThread) {
 #ifdef WINDOWS
 	WaitForSingleObject(hThread, INFINITE);
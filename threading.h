@@ -114,11 +114,79 @@
 #define ISTHREADVALID(thread) (thread != 0)
 #endif
 
+/*
+ * atomic add to a shared counter, returns the value
+ * the counter had before the add
+ */
+#ifdef WINDOWS
+#define ATOMIC_ADD(ptr, val) ((sizeof(*(ptr)) == sizeof(LONGLONG)) \
+		? InterlockedExchangeAdd64((LONGLONG volatile *) (ptr), (LONGLONG) (val)) \
+		: InterlockedExchangeAdd((LONG volatile *) (ptr), (LONG) (val)))
+#else
+#define ATOMIC_ADD(ptr, val) __sync_fetch_and_add((ptr), (val))
+#endif
+
+/*
+ * atomic or into a shared 64 bit word
+ */
+#ifdef WINDOWS
+#define ATOMIC_OR(ptr, val) InterlockedOr64((LONGLONG volatile *) (ptr), (LONGLONG) (val))
+#else
+#define ATOMIC_OR(ptr, val) __sync_fetch_and_or((ptr), (val))
+#endif
+
+/*
+ * atomic compare and swap of a shared 64 bit word, TRUE
+ * if the word held old and was set to new
+ */
+#ifdef WINDOWS
+#define ATOMIC_CAS(ptr, old, new) (InterlockedCompareExchange64((LONGLONG volatile *) (ptr), (LONGLONG) (new), (LONGLONG) (old)) == (LONGLONG) (old))
+#else
+#define ATOMIC_CAS(ptr, old, new) __sync_bool_compare_and_swap((ptr), (old), (new))
+#endif
+
+/*
+ * waits, holding Mutex, for Cond to be signaled or for msec to pass,
+ * Mutex is held again on return.  On Windows Cond is an auto reset
+ * event, so a broadcast only wakes a single waiter.
+ */
+#ifdef WINDOWS
+#define COND_WAIT(Cond, Mutex, msec) \
+		SignalObjectAndWait((void *) Mutex, (void *) Cond, msec, FALSE); \
+		WaitForSingleObject((void *) Mutex, INFINITE)
+#define COND_BROADCAST(Cond) SetEvent((void *) Cond)
+#else
+#define COND_WAIT(Cond, Mutex, msec) cond_timedwait(&Cond, &Mutex, msec)
+#define COND_BROADCAST(Cond) pthread_cond_broadcast(&Cond)
+int cond_timedwait(pthread_cond_t *, pthread_mutex_t *, unsigned long);
+#endif
+
+/*
+ * counting semaphores, SEM_TIMEDWAIT returns 0 if Sem was taken
+ * before msec passed
+ */
+#ifdef WINDOWS
+#define SEM_WAIT(Sem) WaitForSingleObject((void *) Sem, INFINITE)
+#define SEM_TIMEDWAIT(Sem, msec) ((WaitForSingleObject((void *) Sem, msec) == WAIT_OBJECT_0) ? 0 : -1)
+#define SEM_POST(Sem, count) ReleaseSemaphore((void *) Sem, count, NULL)
+#else
+#define SEM_WAIT(Sem) sem_timedwait_ms(&Sem, 0)
+#define SEM_TIMEDWAIT(Sem, msec) sem_timedwait_ms(&Sem, msec)
+#define SEM_POST(Sem, count) sem_post_n(&Sem, count)
+int sem_timedwait_ms(sem_t *, unsigned long);
+void sem_post_n(sem_t *, unsigned int);
+#endif
+
 void cleanUpTestChildren(test_ll_t *);
-void CreateTestChild(void *, test_ll_t *);
-hThread_t spawnThread(void *, void *);
+void CreateTestChild(void *, test_ll_t *, const unsigned int *, const unsigned int);
+hThread_t spawnThread(void *, void *, const unsigned int *, const unsigned int);
 void closeThread(hThread_t);
 void createChild(void *, test_ll_t *);
 void cleanUp(test_ll_t *);
+void CreateTestPool(test_ll_t *);
+void RunTestPool(test_ll_t *);
+void cleanUpTestPool(test_ll_t *);
+int initAffinity(test_ll_t *);
+void reportAffinity(test_ll_t *);
 
 #endif /* THREADING_H */
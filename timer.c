@@ -54,6 +54,7 @@
 #include "sfunc.h"
 #include "stats.h"
 #include "signals.h"
+#include "timer.h"
 
 /*
  * The main purpose of this thread is track time during the test. Along with
@@ -61,6 +62,10 @@
  * IO threads are making progress. The timer thread is started before any IO
  * threads and will complete either after all IO threads exit, the test fails,
  * or if a timed run, the run time is exceeded.
+ *
+ * Intervals tick on one second deadlines from the monotonic clock, and
+ * the read/write time is charged with the time that really elapsed, so
+ * a late or shortened tick does not skew the heartbeat rates.
  */
 #ifdef WINDOWS
 DWORD WINAPI ChildTimer(test_ll_t *test)
@@ -78,6 +83,10 @@ void *ChildTimer(void *vtest)
 
 	OFF_T tmp_io_count = 0;
 	time_t run_time = 0;
+	time_t next_hbeat = 0;
+	OFF_T start, now, last, next;
+	double elapsed;
+	BOOL bDone = FALSE;
 
 	lvl_t msg_level = WARN;
 
@@ -91,28 +100,48 @@ void *ChildTimer(void *vtest)
 #ifdef _DEBUG
 	PDBG3(DBUG, args, "In timer %lu, %d\n", time(NULL), env->bContinue);
 #endif
+	start = last = getMonoTime();
+	next = start + NSECS_PER_SEC;
+	next_hbeat = args->hbeat;
 	do {
-		Sleep(1000);
-		run_time++;
+		/* wake up early when the pool children finish, hand SemDONE back for the main thread */
+		now = getMonoTime();
+		if(SEM_TIMEDWAIT(env->mutexs.SemDONE, (next > now) ? (unsigned long) ((next - now + 999999) / 1000000) : 1) == 0) {
+			bDone = TRUE;
+			SEM_POST(env->mutexs.SemDONE, 1);
+		}
+		now = getMonoTime();
+		if(!bDone && (now < next)) {
+			continue;
+		}
+		if(now >= next) {
+			next += NSECS_PER_SEC;
+			if(next <= now) {	/* more than a tick behind, skip the ones missed */
+				next = now + NSECS_PER_SEC;
+			}
+		}
+		elapsed = (double) (now - last) / (double) NSECS_PER_SEC;
+		last = now;
+		run_time = (time_t) ((now - start) / NSECS_PER_SEC);
 #ifdef _DEBUG
 		PDBG3(DBUG, args, "Continue timing %lu, %lu, %d\n", time(NULL), run_time, env->bContinue);
 #endif
 		if(args->flags & CLD_FLG_W) {
 			if((args->flags & CLD_FLG_LINEAR) && !(args->flags & CLD_FLG_NTRLVD)) {
 				if(TST_OPER(args->test_state) == WRITER) {
-					env->hbeat_stats.wtime++;
+					env->hbeat_stats.wtime += elapsed;
 				}
 			} else {
-				env->hbeat_stats.wtime++;
+				env->hbeat_stats.wtime += elapsed;
 			}
 		} 
 		if(args->flags & CLD_FLG_R) {
 			if((args->flags & CLD_FLG_LINEAR) && !(args->flags & CLD_FLG_NTRLVD)) {
 				if(TST_OPER(args->test_state) == READER) {
-					env->hbeat_stats.rtime++;
+					env->hbeat_stats.rtime += elapsed;
 				}
 			} else {
-				env->hbeat_stats.rtime++;
+				env->hbeat_stats.rtime += elapsed;
 			}
 		}
 
@@ -120,6 +149,7 @@ void *ChildTimer(void *vtest)
 		 * Check to see if we have made any IO progress in the last interval,
 		 * if not incremment the ioTimeout timer, otherwise, clear it
 		 */
+		collect_stats(args, env);
 		cur_total_io_count = env->global_stats.wcount	\
 						+ env->cycle_stats.wcount		\
 						+ env->hbeat_stats.wcount		\
@@ -165,8 +195,12 @@ void *ChildTimer(void *vtest)
 #endif
 		} 
 
-		if(((args->hbeat > 0) && ((run_time % args->hbeat) == 0)) || (signal_action & SIGNAL_STAT)) {
+		if(((args->hbeat > 0) && (run_time >= next_hbeat)) || (signal_action & SIGNAL_STAT)) {
+			while((args->hbeat > 0) && (next_hbeat <= run_time)) {
+				next_hbeat += args->hbeat;
+			}
 			print_stats(args, env, HBEAT);
+			log_stats(args, env, HBEAT);
 			update_cyc_stats(args, env);
 			clear_stat_signal();
 		}
@@ -175,20 +209,20 @@ void *ChildTimer(void *vtest)
 		if(signal_action & SIGNAL_STOP) { break; }	/* user request to stop */
 
 		if(args->flags & CLD_FLG_TMD) {			/* if timing */
-			if(env->kids <= 1) {	/* and the timer is the only child, something must have happened */
+			if(bDone) {				/* and the pool children are done, something must have happened */
 				break;
 			}
 			if(run_time >= args->run_time) {	/* and run time exceeded */
 				break;
 			}
 		} else {					/* if not timing */
-			if(env->kids <= 1) {	/* and the timer is the only child */
+			if(bDone) {				/* and the pool children are done */
 				break;
 			}
 		}
 	} while(TRUE);
 #ifdef _DEBUG
-	PDBG3(DBUG, args, "Out of timer %lu, %lu, %d, %d\n", time(NULL), run_time, env->bContinue, env->kids);
+	PDBG3(DBUG, args, "Out of timer %lu, %lu, %d, %d\n", time(NULL), run_time, env->bContinue, env->active);
 #endif
 
 	if(args->flags & CLD_FLG_TMD) { /* timed test, timer exit needs to stop io threads */
@@ -201,44 +235,64 @@ void *ChildTimer(void *vtest)
 	TEXIT(GETLASTERROR());
 }
 
-#ifdef _DEBUG
+/*
+ * nsecs from a monotonic clock, only good for differences
+ */
+OFF_T getMonoTime(void)
+{
 #ifdef WINDOWS
-DWORD startTime;
-DWORD endTime;
+	LARGE_INTEGER count, freq;
 
-void setStartTime(void) {
-	startTime = GetTickCount();
-}
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (OFF_T) ((double) count.QuadPart * (double) NSECS_PER_SEC / (double) freq.QuadPart);
+#else
+	struct timespec ts;
 
-void setEndTime(void) {
-	endTime = GetTickCount();
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((OFF_T) ts.tv_sec * NSECS_PER_SEC) + ts.tv_nsec;
+#endif
 }
 
-unsigned long getTimeDiff(void) {
-	if((endTime - startTime) < 0) return (0);
-	else return((endTime - startTime) * 1000); /* since we report in usecs, and windows is msec, multiply by 1000 */
-}
+/*
+ * sleeps until when, nsecs from getMonoTime
+ */
+void sleepUntil(const OFF_T when)
+{
+#ifdef WINDOWS
+	OFF_T now;
+	DWORD msecs;
+
+	/* Sleep only has msec resolution, so yield for the last one */
+	while((now = getMonoTime()) < when) {
+		msecs = (DWORD) ((when - now) / 1000000);
+		Sleep((msecs > 1) ? msecs - 1 : 0);
+	}
 #else
-struct timeval tv_start; struct timeval tv_end;
+	struct timespec ts;
+
+	if(when <= getMonoTime()) return;
+	ts.tv_sec = (time_t) (when / NSECS_PER_SEC);
+	ts.tv_nsec = (long) (when % NSECS_PER_SEC);
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#endif
+}
+
+#ifdef _DEBUG
+static OFF_T startTime;
+static OFF_T endTime;
 
 void setStartTime(void) {
-	gettimeofday(&tv_start, NULL);
+	startTime = getMonoTime();
 }
 
 void setEndTime(void) {
-	gettimeofday(&tv_end, NULL);
+	endTime = getMonoTime();
 }
 
+/* usecs between the last setStartTime and setEndTime */
 unsigned long getTimeDiff(void) {
-	if((tv_end.tv_usec - tv_start.tv_usec) < 0) {
-printf("%lu, %lu\n", tv_end.tv_usec, tv_start.tv_usec);
-printf("Here");
-		exit(1);
-	}
-	if((tv_end.tv_usec - tv_start.tv_usec) < 0) return (0);
-	return(tv_end.tv_usec - tv_start.tv_usec);
+	if(endTime < startTime) return (0);
+	return((unsigned long) ((endTime - startTime) / 1000));
 }
-
-
-#endif
 #endif
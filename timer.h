@@ -30,6 +30,10 @@
 #ifndef _TIMER_H_ /* _TIMER_H */
 #define _TIMER_H_
 
+#define NSECS_PER_SEC	1000000000LL
+
+OFF_T getMonoTime(void);
+void sleepUntil(const OFF_T);
 void setStartTime(void);
 void setEndTime(void);
 unsigned long getTimeDiff(void);
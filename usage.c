@@ -35,6 +35,7 @@ void usage(void)
 	printf("\t-?\t\tDisplay this help text and exit.\n");
 	printf("\t-a seed\t\tSets seed for random number generation.\n");
 	printf("\t-A action\tSpecifies modified actions during runtime.\n");
+	printf("\t-b cpus[:cpus]\tBind test threads [and timer] to CPUs, n for NUMA.\n");
 	printf("\t-B lblk[:hblk]\tSet the block transfer size.\n");
 	printf("\t-c\t\tUse a counting sequence as the data pattern.\n");
 	printf("\t-C cycles\tRun until cycles disk access cycles are complete.\n");
@@ -43,15 +44,18 @@ void usage(void)
 	printf("\t-E cmp_len\tTurn on error checking comparing <cmp_len> bytes.\n");
 	printf("\t-f byte\t\tUse a fixed data pattern up to 8 bytes.\n");
 	printf("\t-F \t\tfilespec is a file describing a list of targets\n");
+	printf("\t-g iops[:f|p]\tIssue IO open loop, on an even or Poisson schedule.\n");
 	printf("\t-h hbeat\tDisplays performance statistic every <hbeat> seconds.\n");
 	printf("\t-I IO_type\tSet the data transfer type to IO_type.\n");
 	printf("\t-K threads\tSet the number of test threads.\n");
+	printf("\t-l [r|w]iops[:bw]\tCap IOPS and bytes/sec, for reads, writes or all IO.\n");
 	printf("\t-L seeks\tTotal number of seeks to occur.\n");
 	printf("\t-m\t\tMark each LBA with header information.\n");
 	printf("\t-M marker\tSpecify an alternate marker then start time.\n");
 	printf("\t-n\t\tUse the LBA number as the data pattern.\n");
 	printf("\t-N num_secs\tSet the number of available sectors.\n");
 	printf("\t-o offset\tSet lba alignment offset.\n");
+	printf("\t-O fmt:file\tWrite json or csv stats records to file, - or &fd.\n");
 	printf("\t-p seek_pattern\tSet the pattern of disk seeks.\n");
 	printf("\t-P perf_opts\tDisplays performance statistic.\n");
 	printf("\t-q\t\tSuppress INFO level messages.\n");
@@ -65,4 +69,5 @@ void usage(void)
 	printf("\t-w\t\tWrite data to disk.\n");
 	printf("\t-v\t\tDisplay version information and exit.\n");
 	printf("\t-z\t\tUse randomly generated data as the data pattern.\n");
+	printf("\t-Z cmp[:ddp]\tCompression [and dedupe] ratio of random data.\n");
 }